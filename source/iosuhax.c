@@ -25,104 +25,209 @@
 #include <malloc.h>
 #include "os_functions.h"
 #include "iosuhax.h"
+#include "iosuhax_pool.h"
+#include "iosuhax_internal.h"
 
-#define IOSUHAX_MAGIC_WORD          0x4E696365
-
-#define IOCTL_MEM_WRITE             0x00
-#define IOCTL_MEM_READ              0x01
-#define IOCTL_SVC                   0x02
-#define IOCTL_MEMCPY                0x04
-#define IOCTL_REPEATED_WRITE        0x05
-#define IOCTL_KERN_READ32           0x06
-#define IOCTL_KERN_WRITE32          0x07
-
-#define IOCTL_FSA_OPEN              0x40
-#define IOCTL_FSA_CLOSE             0x41
-#define IOCTL_FSA_MOUNT             0x42
-#define IOCTL_FSA_UNMOUNT           0x43
-#define IOCTL_FSA_GETDEVICEINFO     0x44
-#define IOCTL_FSA_OPENDIR           0x45
-#define IOCTL_FSA_READDIR           0x46
-#define IOCTL_FSA_CLOSEDIR          0x47
-#define IOCTL_FSA_MAKEDIR           0x48
-#define IOCTL_FSA_OPENFILE          0x49
-#define IOCTL_FSA_READFILE          0x4A
-#define IOCTL_FSA_WRITEFILE         0x4B
-#define IOCTL_FSA_STATFILE          0x4C
-#define IOCTL_FSA_CLOSEFILE         0x4D
-#define IOCTL_FSA_SETFILEPOS        0x4E
-#define IOCTL_FSA_GETSTAT           0x4F
-#define IOCTL_FSA_REMOVE            0x50
-#define IOCTL_FSA_REWINDDIR         0x51
-#define IOCTL_FSA_CHDIR             0x52
-#define IOCTL_FSA_RENAME            0x53
-#define IOCTL_FSA_RAW_OPEN          0x54
-#define IOCTL_FSA_RAW_READ          0x55
-#define IOCTL_FSA_RAW_WRITE         0x56
-#define IOCTL_FSA_RAW_CLOSE         0x57
-#define IOCTL_FSA_CHANGEMODE        0x58
-#define IOCTL_FSA_FLUSHVOLUME       0x59
-#define IOCTL_CHECK_IF_IOSUHAX      0x5B
-
-static int iosuhaxHandle = -1;
-
-#define ALIGN(align)       __attribute__((aligned(align)))
-#define ROUNDUP(x, align)  (((x) + ((align) - 1)) & ~((align) - 1))
+static iosuhax_ctx_t defaultCtx = IOSUHAX_CTX_INITIALIZER;
 
-int IOSUHAX_Open(const char *dev)
+//! reads from this size on go directly into cache aligned caller buffers
+#define FSA_DIRECT_IO_MIN_SIZE      0x8000
+#define FSA_DIRECT_IO_HEAD_MAX      0x200
+
+//! gaps up to this size between vectored memory reads are read along instead of starting a new read
+#define MEMV_MERGE_GAP              0x100
+#define MEMV_MAX_SPAN               0x8000
+#define MEMFILL_SEED_SIZE           0x100
+#define KERN_MAX_RUN_WORDS          0x100
+
+//! copied transfers are split into chunks of at most this size, see IOSUHAX_SetTransferChunkSize
+#define FSA_TRANSFER_CHUNK_SIZE     0x20000
+
+static uint32_t transferChunkSize = FSA_TRANSFER_CHUNK_SIZE;
+
+static int iosuhax_ctx_open(iosuhax_ctx_t *ctx, const char *dev)
 {
-    if(iosuhaxHandle >= 0)
-        return iosuhaxHandle;
+    if(ctx->handle >= 0)
+        return ctx->handle;
 
-    iosuhaxHandle = IOS_Open((char*)(dev ? dev : "/dev/iosuhax"), 0);
-    if(iosuhaxHandle >= 0 && dev) //make sure device is actually iosuhax
+    ctx->handle = IOS_Open((char*)(dev ? dev : "/dev/iosuhax"), 0);
+    if(ctx->handle >= 0 && dev) //make sure device is actually iosuhax
     {
         ALIGN(0x20) int res[0x20 >> 2];
         *res = 0;
 
-        IOS_Ioctl(iosuhaxHandle, IOCTL_CHECK_IF_IOSUHAX, (void*)0, 0, res, 4);
+        IOS_Ioctl(ctx->handle, IOCTL_CHECK_IF_IOSUHAX, (void*)0, 0, res, 4);
         if(*res != IOSUHAX_MAGIC_WORD)
         {
-            IOS_Close(iosuhaxHandle);
-            iosuhaxHandle = -1;
+            IOS_Close(ctx->handle);
+            ctx->handle = -1;
+        }
+    }
+
+    if(ctx->handle >= 0)
+    {
+        iosuhax_pool_init(&ctx->pool);
+
+        if(!ctx->initialized)
+        {
+            OSInitMutex(ctx->mutex);
+            ctx->initialized = 1;
         }
     }
 
-    return iosuhaxHandle;
+    return ctx->handle;
 }
 
-int IOSUHAX_Close(void)
+static int iosuhax_ctx_close(iosuhax_ctx_t *ctx)
 {
-    if(iosuhaxHandle < 0)
+    if(ctx->handle < 0)
         return 0;
 
-    int res = IOS_Close(iosuhaxHandle);
-    iosuhaxHandle = -1;
+    int res = IOS_Close(ctx->handle);
+    ctx->handle = -1;
+    iosuhax_pool_drain(&ctx->pool);
     return res;
 }
 
-int IOSUHAX_memwrite(uint32_t address, const uint8_t * buffer, uint32_t size)
+//! FSA client handles are tracked so a context can release them all when it is closed
+static void iosuhax_ctx_track_fsa(iosuhax_ctx_t *ctx, int fsaFd, int add)
+{
+    uint32_t i;
+
+    OSLockMutex(ctx->mutex);
+
+    if(add)
+    {
+        if(ctx->fsa_cnt < IOSUHAX_CTX_MAX_FSA_HANDLES)
+            ctx->fsa_handles[ctx->fsa_cnt++] = fsaFd;
+    }
+    else
+    {
+        for(i = 0; i < ctx->fsa_cnt; i++)
+        {
+            if(ctx->fsa_handles[i] == fsaFd)
+            {
+                ctx->fsa_handles[i] = ctx->fsa_handles[--ctx->fsa_cnt];
+                break;
+            }
+        }
+    }
+
+    OSUnlockMutex(ctx->mutex);
+}
+
+iosuhax_ctx_t *IOSUHAX_CtxOpen(const char *dev)
+{
+    static const iosuhax_ctx_t ctx_template = IOSUHAX_CTX_INITIALIZER;
+
+    iosuhax_ctx_t *ctx = (iosuhax_ctx_t*)malloc(sizeof(iosuhax_ctx_t));
+    if(!ctx)
+        return NULL;
+
+    memcpy(ctx, &ctx_template, sizeof(iosuhax_ctx_t));
+
+    if(iosuhax_ctx_open(ctx, dev) < 0)
+    {
+        free(ctx);
+        return NULL;
+    }
+
+    return ctx;
+}
+
+int IOSUHAX_CtxClose(iosuhax_ctx_t *ctx)
+{
+    if(!ctx || ctx == &defaultCtx)
+        return IOS_ERROR_INVALID_ARG;
+
+    //! close every handle once, a failed close leaves it tracked
+    int fsa_handles[IOSUHAX_CTX_MAX_FSA_HANDLES];
+    uint32_t fsa_cnt = ctx->fsa_cnt;
+    uint32_t i;
+
+    memcpy(fsa_handles, ctx->fsa_handles, fsa_cnt * sizeof(int));
+
+    for(i = 0; i < fsa_cnt; i++)
+        IOSUHAX_Ctx_FSA_Close(ctx, fsa_handles[i]);
+
+    int res = iosuhax_ctx_close(ctx);
+    free(ctx);
+    return res;
+}
+
+iosuhax_ctx_t *IOSUHAX_GetDefaultCtx(void)
+{
+    return &defaultCtx;
+}
+
+int IOSUHAX_Open(const char *dev)
+{
+    return iosuhax_ctx_open(&defaultCtx, dev);
+}
+
+int IOSUHAX_Close(void)
+{
+    return iosuhax_ctx_close(&defaultCtx);
+}
+
+void IOSUHAX_SetTransferChunkSize(uint32_t chunk_size)
+{
+    if(chunk_size < 0x200)
+        chunk_size = 0x200;
+
+    transferChunkSize = ROUNDUP(chunk_size, 0x40);
+}
+
+uint32_t IOSUHAX_GetTransferChunkSize(void)
+{
+    return transferChunkSize;
+}
+
+void IOSUHAX_Ctx_SetBufferPoolLimit(iosuhax_ctx_t *ctx, uint32_t max_cached_bytes)
+{
+    iosuhax_pool_set_limit(&ctx->pool, max_cached_bytes);
+}
+
+void IOSUHAX_Ctx_GetBufferPoolStats(iosuhax_ctx_t *ctx, bufferPoolStats_s *stats)
+{
+    stats->cached = ctx->pool.cached_bytes;
+    stats->in_use = ctx->pool.used_bytes;
+    stats->high_water = ctx->pool.high_water;
+    stats->limit = ctx->pool.limit;
+}
+
+void IOSUHAX_SetBufferPoolLimit(uint32_t max_cached_bytes)
+{
+    IOSUHAX_Ctx_SetBufferPoolLimit(&defaultCtx, max_cached_bytes);
+}
+
+void IOSUHAX_GetBufferPoolStats(bufferPoolStats_s *stats)
+{
+    IOSUHAX_Ctx_GetBufferPoolStats(&defaultCtx, stats);
+}
+
+int IOSUHAX_Ctx_memwrite(iosuhax_ctx_t *ctx, uint32_t address, const uint8_t * buffer, uint32_t size)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, ROUNDUP(size + 4, 0x20));
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, ROUNDUP(size + 4, 0x20));
     if(!io_buf)
         return -2;
 
     io_buf[0] = address;
     memcpy(io_buf + 1, buffer, size);
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_MEM_WRITE, io_buf, size + 4, 0, 0);
+    int res = IOS_Ioctl(ctx->handle, IOCTL_MEM_WRITE, io_buf, size + 4, 0, 0);
 
-    free(io_buf);
+    iosuhax_pool_free(&ctx->pool, io_buf, ROUNDUP(size + 4, 0x20));
     return res;
 }
 
-int IOSUHAX_memread(uint32_t address, uint8_t * out_buffer, uint32_t size)
+int IOSUHAX_Ctx_memread(iosuhax_ctx_t *ctx, uint32_t address, uint8_t * out_buffer, uint32_t size)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     ALIGN(0x20) int io_buf[0x20 >> 2];
     io_buf[0] = address;
@@ -131,90 +236,423 @@ int IOSUHAX_memread(uint32_t address, uint8_t * out_buffer, uint32_t size)
 
     if(((uintptr_t)out_buffer & 0x1F) || (size & 0x1F))
     {
-       tmp_buf = (uint32_t*)memalign(0x20, ROUNDUP(size, 0x20));
+       tmp_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, ROUNDUP(size, 0x20));
        if(!tmp_buf)
            return -2;
     }
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_MEM_READ, io_buf, sizeof(address), tmp_buf ? tmp_buf : out_buffer, size);
+    int res = IOS_Ioctl(ctx->handle, IOCTL_MEM_READ, io_buf, sizeof(address), tmp_buf ? tmp_buf : out_buffer, size);
 
     if(res >= 0 && tmp_buf)
        memcpy(out_buffer, tmp_buf, size);
 
-    free(tmp_buf);
+    iosuhax_pool_free(&ctx->pool, tmp_buf, ROUNDUP(size, 0x20));
     return res;
 }
 
-int IOSUHAX_memcpy(uint32_t dst, uint32_t src, uint32_t size)
+//! Reads every descriptor with as few IOSU round-trips as possible. The descriptors are visited
+//! in address order and ranges that are less than MEMV_MERGE_GAP apart are fetched with one read.
+int IOSUHAX_Ctx_memreadv(iosuhax_ctx_t *ctx, const memVector_s *vec, uint32_t vec_cnt)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    if(!vec_cnt)
+        return 0;
+
+    uint32_t *order = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, vec_cnt * sizeof(uint32_t));
+    if(!order)
+        return -2;
+
+    uint32_t i, k;
+
+    //! insertion sort, these lists are short
+    for(i = 0; i < vec_cnt; i++)
+    {
+        k = i;
+        while(k > 0 && vec[order[k - 1]].address > vec[i].address)
+        {
+            order[k] = order[k - 1];
+            k--;
+        }
+        order[k] = i;
+    }
+
+    uint8_t *tmp_buf = (uint8_t*)iosuhax_pool_alloc(&ctx->pool, MEMV_MAX_SPAN);
+    if(!tmp_buf)
+    {
+        iosuhax_pool_free(&ctx->pool, order, vec_cnt * sizeof(uint32_t));
+        return -2;
+    }
+
+    ALIGN(0x20) int io_buf[0x20 >> 2];
+    int res = 0;
+
+    i = 0;
+    while(i < vec_cnt && res >= 0)
+    {
+        const memVector_s *first = &vec[order[i]];
+
+        //! too large to merge, read straight into the caller buffer
+        if(first->size > MEMV_MAX_SPAN)
+        {
+            res = IOSUHAX_Ctx_memread(ctx, first->address, (uint8_t*)first->buffer, first->size);
+            i++;
+            continue;
+        }
+
+        uint32_t start = first->address;
+        uint32_t end = first->address + first->size;
+
+        for(k = i + 1; k < vec_cnt; k++)
+        {
+            const memVector_s *next = &vec[order[k]];
+            uint32_t next_end = next->address + next->size;
+
+            if(next->address > end + MEMV_MERGE_GAP)
+                break;
+            if(next_end > end)
+            {
+                if(next_end - start > MEMV_MAX_SPAN)
+                    break;
+                end = next_end;
+            }
+        }
+
+        io_buf[0] = start;
+
+        res = IOS_Ioctl(ctx->handle, IOCTL_MEM_READ, io_buf, sizeof(start), tmp_buf, end - start);
+        if(res >= 0)
+        {
+            for(; i < k; i++)
+                memcpy(vec[order[i]].buffer, tmp_buf + (vec[order[i]].address - start), vec[order[i]].size);
+        }
+    }
+
+    iosuhax_pool_free(&ctx->pool, tmp_buf, MEMV_MAX_SPAN);
+    iosuhax_pool_free(&ctx->pool, order, vec_cnt * sizeof(uint32_t));
+    return (res < 0) ? res : 0;
+}
+
+//! Writes the descriptors in the given order, so overlapping writes keep their meaning.
+//! Consecutive descriptors that continue exactly where the previous one ended are sent as one write.
+int IOSUHAX_Ctx_memwritev(iosuhax_ctx_t *ctx, const memVector_s *vec, uint32_t vec_cnt)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    if(!vec_cnt)
+        return 0;
+
+    uint32_t io_buf_size = ROUNDUP(MEMV_MAX_SPAN + 4, 0x20);
+
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
+    if(!io_buf)
+        return -2;
+
+    uint32_t i = 0, k;
+    int res = 0;
+
+    while(i < vec_cnt && res >= 0)
+    {
+        if(vec[i].size > MEMV_MAX_SPAN)
+        {
+            res = IOSUHAX_Ctx_memwrite(ctx, vec[i].address, (const uint8_t*)vec[i].buffer, vec[i].size);
+            i++;
+            continue;
+        }
+
+        uint32_t size = 0;
+
+        io_buf[0] = vec[i].address;
+
+        for(k = i; k < vec_cnt; k++)
+        {
+            if(k > i && vec[k].address != vec[i].address + size)
+                break;
+            if(size + vec[k].size > MEMV_MAX_SPAN)
+                break;
+
+            memcpy(((uint8_t*)(io_buf + 1)) + size, vec[k].buffer, vec[k].size);
+            size += vec[k].size;
+        }
+
+        res = IOS_Ioctl(ctx->handle, IOCTL_MEM_WRITE, io_buf, size + 4, 0, 0);
+        i = k;
+    }
+
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
+    return (res < 0) ? res : 0;
+}
+
+int IOSUHAX_Ctx_memcpy(iosuhax_ctx_t *ctx, uint32_t dst, uint32_t src, uint32_t size)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     ALIGN(0x20) uint32_t io_buf[0x20 >> 2];
     io_buf[0] = dst;
     io_buf[1] = src;
     io_buf[2] = size;
 
-    return IOS_Ioctl(iosuhaxHandle, IOCTL_MEMCPY, io_buf, 3 * sizeof(uint32_t), 0, 0);
+    return IOS_Ioctl(ctx->handle, IOCTL_MEMCPY, io_buf, 3 * sizeof(uint32_t), 0, 0);
 }
 
-int IOSUHAX_SVC(uint32_t svc_id, uint32_t * args, uint32_t arg_cnt)
+//! Writes one small seed of the pattern and lets IOSU replicate it with doubling internal memcpys,
+//! so filling a region costs O(log size) constant sized requests. IOCTL_REPEATED_WRITE is not
+//! used for this as the resident side implements it as a wait-for-change-then-patch loop on one word.
+int IOSUHAX_Ctx_memfill(iosuhax_ctx_t *ctx, uint32_t address, const void *pattern, uint32_t pattern_size, uint32_t size)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    if(!pattern || !pattern_size || pattern_size > MEMFILL_SEED_SIZE)
+        return IOS_ERROR_INVALID_ARG;
+
+    if(!size)
+        return 0;
+
+    ALIGN(0x20) uint8_t seed[MEMFILL_SEED_SIZE];
+
+    uint32_t seed_size = (MEMFILL_SEED_SIZE / pattern_size) * pattern_size;
+    if(seed_size > size)
+        seed_size = size;
+
+    uint32_t i;
+    for(i = 0; i < seed_size; i += pattern_size)
+        memcpy(seed + i, pattern, (seed_size - i < pattern_size) ? (seed_size - i) : pattern_size);
+
+    int res = IOSUHAX_Ctx_memwrite(ctx, address, seed, seed_size);
+
+    uint32_t filled = seed_size;
+
+    while(res >= 0 && filled < size)
+    {
+        uint32_t copy_size = size - filled;
+        if(copy_size > filled)
+            copy_size = filled;
+
+        res = IOSUHAX_Ctx_memcpy(ctx, address + filled, address, copy_size);
+        filled += copy_size;
+    }
+
+    return res;
+}
+
+int IOSUHAX_Ctx_memset(iosuhax_ctx_t *ctx, uint32_t address, uint8_t value, uint32_t size)
+{
+    return IOSUHAX_Ctx_memfill(ctx, address, &value, 1, size);
+}
+
+//! the resident side reads one word per 4 bytes of output starting at the given address
+int IOSUHAX_Ctx_kern_read32(iosuhax_ctx_t *ctx, uint32_t address, uint32_t *out_buffer, uint32_t count)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    ALIGN(0x20) uint32_t io_buf[0x20 >> 2];
+    io_buf[0] = address;
+
+    uint32_t out_buf_size = ROUNDUP(count * sizeof(uint32_t), 0x20);
+
+    uint32_t *out_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, out_buf_size);
+    if(!out_buf)
+        return -2;
+
+    int res = IOS_Ioctl(ctx->handle, IOCTL_KERN_READ32, io_buf, sizeof(address), out_buf, count * sizeof(uint32_t));
+    if(res >= 0)
+        memcpy(out_buffer, out_buf, count * sizeof(uint32_t));
+
+    iosuhax_pool_free(&ctx->pool, out_buf, out_buf_size);
+    return res;
+}
+
+//! the resident side writes each word after the address to consecutive addresses
+static int IOSUHAX_kern_write32_run(iosuhax_ctx_t *ctx, uint32_t address, const uint32_t *values, uint32_t count)
+{
+    uint32_t io_buf_size = ROUNDUP((count + 1) * sizeof(uint32_t), 0x20);
+
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
+    if(!io_buf)
+        return -2;
+
+    io_buf[0] = address;
+    memcpy(io_buf + 1, values, count * sizeof(uint32_t));
+
+    int res = IOS_Ioctl(ctx->handle, IOCTL_KERN_WRITE32, io_buf, (count + 1) * sizeof(uint32_t), 0, 0);
+
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
+    return res;
+}
+
+int IOSUHAX_Ctx_kern_write32(iosuhax_ctx_t *ctx, uint32_t address, uint32_t value)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    return IOSUHAX_kern_write32_run(ctx, address, &value, 1);
+}
+
+//! runs of consecutive word addresses are read with one request
+int IOSUHAX_Ctx_kern_read32v(iosuhax_ctx_t *ctx, const uint32_t *addresses, uint32_t *values, uint32_t count)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    uint32_t i = 0;
+    int res = 0;
+
+    while(i < count && res >= 0)
+    {
+        uint32_t run = 1;
+        while(i + run < count && run < KERN_MAX_RUN_WORDS && addresses[i + run] == addresses[i] + run * sizeof(uint32_t))
+            run++;
+
+        res = IOSUHAX_Ctx_kern_read32(ctx, addresses[i], values + i, run);
+        i += run;
+    }
+
+    return (res < 0) ? res : 0;
+}
+
+//! runs of consecutive word addresses are written with one request, in the given order
+int IOSUHAX_Ctx_kern_write32v(iosuhax_ctx_t *ctx, const uint32_t *addresses, const uint32_t *values, uint32_t count)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    uint32_t i = 0;
+    int res = 0;
+
+    while(i < count && res >= 0)
+    {
+        uint32_t run = 1;
+        while(i + run < count && run < KERN_MAX_RUN_WORDS && addresses[i + run] == addresses[i] + run * sizeof(uint32_t))
+            run++;
+
+        res = IOSUHAX_kern_write32_run(ctx, addresses[i], values + i, run);
+        i += run;
+    }
+
+    return (res < 0) ? res : 0;
+}
+
+int IOSUHAX_Ctx_SVC(iosuhax_ctx_t *ctx, uint32_t svc_id, uint32_t * args, uint32_t arg_cnt)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     ALIGN(0x20) uint32_t arguments[0x40 >> 2];
     arguments[0] = svc_id;
 
     if(args && arg_cnt)
     {
-        if(arg_cnt > 8)
-            arg_cnt = 8;
+        if(arg_cnt > SVC_MAX_ARGS)
+            arg_cnt = SVC_MAX_ARGS;
 
         memcpy(arguments + 1, args, arg_cnt * 4);
     }
 
     ALIGN(0x20) int result[0x20 >> 2];
-    int ret = IOS_Ioctl(iosuhaxHandle, IOCTL_SVC, arguments, (1 + arg_cnt) * 4, result, 4);
+    int ret = IOS_Ioctl(ctx->handle, IOCTL_SVC, arguments, (1 + arg_cnt) * 4, result, 4);
     if(ret < 0)
         return ret;
 
     return *result;
 }
 
-int IOSUHAX_FSA_Open(void)
+//! The resident side has no batch command, so the calls are issued back to back from one marshalled
+//! argument block. Arguments flagged in result_args take the result of an earlier call of the batch.
+int IOSUHAX_Ctx_SVC_Batch(iosuhax_ctx_t *ctx, const svcCall_s *calls, uint32_t call_cnt, int *results, int stop_on_error)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    ALIGN(0x20) uint32_t arguments[0x40 >> 2];
+    ALIGN(0x20) int result[0x20 >> 2];
+
+    uint32_t i, n;
+
+    for(i = 0; i < call_cnt; i++)
+    {
+        const svcCall_s *call = &calls[i];
+        int res = 0;
+
+        if(call->arg_cnt > SVC_MAX_ARGS)
+            res = IOS_ERROR_INVALID_ARG;
+
+        arguments[0] = call->svc_id;
+
+        for(n = 0; n < call->arg_cnt && res == 0; n++)
+        {
+            if(call->result_args & (1 << n))
+            {
+                //! only results of calls that already ran can be referenced
+                if(call->args[n] >= i)
+                    res = IOS_ERROR_INVALID_ARG;
+                else
+                    arguments[1 + n] = results[call->args[n]];
+            }
+            else
+            {
+                arguments[1 + n] = call->args[n];
+            }
+        }
+
+        if(res == 0)
+        {
+            res = IOS_Ioctl(ctx->handle, IOCTL_SVC, arguments, (1 + call->arg_cnt) * 4, result, 4);
+            if(res >= 0)
+                res = *result;
+        }
+
+        results[i] = res;
+
+        if(res < 0 && stop_on_error)
+            return i + 1;
+    }
+
+    return call_cnt;
+}
+
+int IOSUHAX_Ctx_FSA_Open(iosuhax_ctx_t *ctx)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     ALIGN(0x20) int io_buf[0x20 >> 2];
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_OPEN, 0, 0, io_buf, sizeof(int));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_OPEN, 0, 0, io_buf, sizeof(int));
     if(res < 0)
         return res;
 
+    if(io_buf[0] >= 0)
+        iosuhax_ctx_track_fsa(ctx, io_buf[0], 1);
+
     return io_buf[0];
 }
 
-int IOSUHAX_FSA_Close(int fsaFd)
+int IOSUHAX_Ctx_FSA_Close(iosuhax_ctx_t *ctx, int fsaFd)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     ALIGN(0x20) int io_buf[0x20 >> 2];
     io_buf[0] = fsaFd;
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_CLOSE, io_buf, sizeof(fsaFd), io_buf, sizeof(fsaFd));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_CLOSE, io_buf, sizeof(fsaFd), io_buf, sizeof(fsaFd));
     if(res < 0)
         return res;
 
+    iosuhax_ctx_track_fsa(ctx, fsaFd, 0);
+
     return io_buf[0];
 }
 
-int IOSUHAX_FSA_Mount(int fsaFd, const char* device_path, const char* volume_path, uint32_t flags, const char* arg_string, int arg_string_len)
+int IOSUHAX_Ctx_FSA_Mount(iosuhax_ctx_t *ctx, int fsaFd, const char* device_path, const char* volume_path, uint32_t flags, const char* arg_string, int arg_string_len)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     const int input_cnt = 6;
 
@@ -236,17 +674,17 @@ int IOSUHAX_FSA_Mount(int fsaFd, const char* device_path, const char* volume_pat
     if(arg_string_len)
         memcpy(((char*)io_buf) + io_buf[4],  arg_string, arg_string_len);
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_MOUNT, io_buf, io_buf_size, io_buf, 4);
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_MOUNT, io_buf, io_buf_size, io_buf, 4);
     if(res < 0)
        return res;
 
     return io_buf[0];
 }
 
-int IOSUHAX_FSA_Unmount(int fsaFd, const char* path, uint32_t flags)
+int IOSUHAX_Ctx_FSA_Unmount(iosuhax_ctx_t *ctx, int fsaFd, const char* path, uint32_t flags)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     const int input_cnt = 3;
 
@@ -259,17 +697,17 @@ int IOSUHAX_FSA_Unmount(int fsaFd, const char* path, uint32_t flags)
     io_buf[2] = flags;
     strcpy(((char*)io_buf) + io_buf[1],  path);
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_UNMOUNT, io_buf, io_buf_size, io_buf, 4);
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_UNMOUNT, io_buf, io_buf_size, io_buf, 4);
     if(res < 0)
        return res;
 
     return io_buf[0];
 }
 
-int IOSUHAX_FSA_FlushVolume(int fsaFd, const char *volume_path)
+int IOSUHAX_Ctx_FSA_FlushVolume(iosuhax_ctx_t *ctx, int fsaFd, const char *volume_path)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     const int input_cnt = 2;
 
@@ -281,116 +719,161 @@ int IOSUHAX_FSA_FlushVolume(int fsaFd, const char *volume_path)
     io_buf[1] = sizeof(uint32_t) * input_cnt;
     strcpy(((char*)io_buf) + io_buf[1], volume_path);
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_FLUSHVOLUME, io_buf, io_buf_size, io_buf, 4);
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_FLUSHVOLUME, io_buf, io_buf_size, io_buf, 4);
     if(res < 0)
         return res;
 
     return io_buf[0];
 }
 
-int IOSUHAX_FSA_GetDeviceInfo(int fsaFd, const char* device_path, int type, uint32_t* out_data)
+//! paths are marshalled as prefix followed by path, prefix may be NULL
+static uint32_t iosuhax_path_len(const char *prefix, const char *path)
+{
+    return (prefix ? strlen(prefix) : 0) + strlen(path);
+}
+
+static void iosuhax_path_copy(char *dst, const char *prefix, const char *path)
+{
+    if(prefix)
+    {
+        while(*prefix)
+            *dst++ = *prefix++;
+    }
+    strcpy(dst, path);
+}
+
+int iosuhax_fsa_get_device_info(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char* device_path, int type, uint32_t* out_data)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    uint32_t path_len = iosuhax_path_len(prefix, device_path);
 
     const int input_cnt = 3;
 
-    int io_buf_size = sizeof(uint32_t) * input_cnt + strlen(device_path) + 1;
+    int io_buf_size = sizeof(uint32_t) * input_cnt + path_len + 1;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
     io_buf[0] = fsaFd;
     io_buf[1] = sizeof(uint32_t) * input_cnt;
     io_buf[2] = type;
-    strcpy(((char*)io_buf) + io_buf[1],  device_path);
+    iosuhax_path_copy(((char*)io_buf) + io_buf[1], prefix, device_path);
 
     uint32_t out_buf[1 + 0x64 / 4];
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_GETDEVICEINFO, io_buf, io_buf_size, out_buf, sizeof(out_buf));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_GETDEVICEINFO, io_buf, io_buf_size, out_buf, sizeof(out_buf));
     if(res < 0)
     {
-        free(io_buf);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
         return res;
     }
 
     memcpy(out_data, out_buf + 1, 0x64);
-    free(io_buf);
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
     return out_buf[0];
 }
 
-int IOSUHAX_FSA_MakeDir(int fsaFd, const char* path, uint32_t flags)
+int IOSUHAX_Ctx_FSA_GetDeviceInfo(iosuhax_ctx_t *ctx, int fsaFd, const char* device_path, int type, uint32_t* out_data)
+{
+    return iosuhax_fsa_get_device_info(ctx, fsaFd, NULL, device_path, type, out_data);
+}
+
+int iosuhax_fsa_make_dir(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char* path, uint32_t flags)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    uint32_t path_len = iosuhax_path_len(prefix, path);
 
     const int input_cnt = 3;
 
-    int io_buf_size = sizeof(uint32_t) * input_cnt + strlen(path) + 1;
+    int io_buf_size = sizeof(uint32_t) * input_cnt + path_len + 1;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
     io_buf[0] = fsaFd;
     io_buf[1] = sizeof(uint32_t) * input_cnt;
     io_buf[2] = flags;
-    strcpy(((char*)io_buf) + io_buf[1],  path);
+    iosuhax_path_copy(((char*)io_buf) + io_buf[1], prefix, path);
 
     int result;
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_MAKEDIR, io_buf, io_buf_size, &result, sizeof(result));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_MAKEDIR, io_buf, io_buf_size, &result, sizeof(result));
     if(res < 0)
     {
-        free(io_buf);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
         return res;
     }
 
-    free(io_buf);
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
     return result;
 }
 
-int IOSUHAX_FSA_OpenDir(int fsaFd, const char* path, int* outHandle)
+int IOSUHAX_Ctx_FSA_MakeDir(iosuhax_ctx_t *ctx, int fsaFd, const char* path, uint32_t flags)
+{
+    return iosuhax_fsa_make_dir(ctx, fsaFd, NULL, path, flags);
+}
+
+int iosuhax_fsa_open_dir(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char* path, int* outHandle)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    uint32_t path_len = iosuhax_path_len(prefix, path);
 
     const int input_cnt = 2;
 
-    int io_buf_size = sizeof(uint32_t) * input_cnt + strlen(path) + 1;
+    int io_buf_size = sizeof(uint32_t) * input_cnt + path_len + 1;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
     io_buf[0] = fsaFd;
     io_buf[1] = sizeof(uint32_t) * input_cnt;
-    strcpy(((char*)io_buf) + io_buf[1],  path);
+    iosuhax_path_copy(((char*)io_buf) + io_buf[1], prefix, path);
 
     int result_vec[2];
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_OPENDIR, io_buf, io_buf_size, result_vec, sizeof(result_vec));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_OPENDIR, io_buf, io_buf_size, result_vec, sizeof(result_vec));
     if(res < 0)
     {
-        free(io_buf);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
         return res;
     }
 
     *outHandle = result_vec[1];
-    free(io_buf);
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
     return result_vec[0];
 }
 
-int IOSUHAX_FSA_ReadDir(int fsaFd, int handle, directoryEntry_s* out_data)
+int IOSUHAX_Ctx_FSA_OpenDir(iosuhax_ctx_t *ctx, int fsaFd, const char* path, int* outHandle)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    return iosuhax_fsa_open_dir(ctx, fsaFd, NULL, path, outHandle);
+}
 
-    const int input_cnt = 2;
+//! The resident only returns one entry per READDIR request, so up to max_entries entries are read
+//! with back to back requests through one set of buffers. Returns the number of entries read or -2,
+//! last_result receives the status that ended the batch (0 if max_entries were read).
+int iosuhax_fsa_read_dir(iosuhax_ctx_t *ctx, int fsaFd, int handle, directoryEntry_s* out_data, uint32_t max_entries, int *last_result)
+{
+    *last_result = 0;
+
+    if(ctx->handle < 0)
+    {
+        *last_result = ctx->handle;
+        return 0;
+    }
+
+    const int input_cnt = 2;
 
     int io_buf_size = sizeof(uint32_t) * input_cnt;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
@@ -398,38 +881,67 @@ int IOSUHAX_FSA_ReadDir(int fsaFd, int handle, directoryEntry_s* out_data)
     io_buf[1] = handle;
 
     int result_vec_size = 4 + sizeof(directoryEntry_s);
-    uint8_t *result_vec = (uint8_t*) memalign(0x20, result_vec_size);
+    uint8_t *result_vec = (uint8_t*) iosuhax_pool_alloc(&ctx->pool, result_vec_size);
     if(!result_vec)
     {
-        free(io_buf);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
         return -2;
     }
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_READDIR, io_buf, io_buf_size, result_vec, result_vec_size);
-    if(res < 0)
+    uint32_t cnt = 0;
+
+    while(cnt < max_entries)
     {
-        free(result_vec);
-        free(io_buf);
-        return res;
+        int result = IOS_Ioctl(ctx->handle, IOCTL_FSA_READDIR, io_buf, io_buf_size, result_vec, result_vec_size);
+        if(result >= 0)
+            result = *(int*)result_vec;
+        if(result < 0)
+        {
+            //! END_OF_DIR included, no further request is sent for this batch
+            *last_result = result;
+            break;
+        }
+
+        memcpy(out_data + cnt, result_vec + 4, sizeof(directoryEntry_s));
+        cnt++;
     }
 
-    int result = *(int*)result_vec;
-    memcpy(out_data, result_vec + 4, sizeof(directoryEntry_s));
-    free(io_buf);
-    free(result_vec);
-    return result;
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
+    iosuhax_pool_free(&ctx->pool, result_vec, result_vec_size);
+
+    return cnt;
 }
 
-int IOSUHAX_FSA_RewindDir(int fsaFd, int dirHandle)
+int IOSUHAX_Ctx_FSA_ReadDir(iosuhax_ctx_t *ctx, int fsaFd, int handle, directoryEntry_s* out_data)
+{
+    int last_result;
+    int cnt = iosuhax_fsa_read_dir(ctx, fsaFd, handle, out_data, 1, &last_result);
+    if(cnt < 0)
+        return cnt;
+
+    return last_result;
+}
+
+int IOSUHAX_Ctx_FSA_ReadDirMulti(iosuhax_ctx_t *ctx, int fsaFd, int handle, directoryEntry_s* out_data, uint32_t max_entries)
+{
+    int last_result;
+    int cnt = iosuhax_fsa_read_dir(ctx, fsaFd, handle, out_data, max_entries, &last_result);
+    if(cnt != 0)
+        return cnt;
+
+    return last_result;
+}
+
+int IOSUHAX_Ctx_FSA_RewindDir(iosuhax_ctx_t *ctx, int fsaFd, int dirHandle)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     const int input_cnt = 2;
 
     int io_buf_size = sizeof(uint32_t) * input_cnt;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
@@ -438,27 +950,27 @@ int IOSUHAX_FSA_RewindDir(int fsaFd, int dirHandle)
 
     int result;
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_REWINDDIR, io_buf, io_buf_size, &result, sizeof(result));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_REWINDDIR, io_buf, io_buf_size, &result, sizeof(result));
     if(res < 0)
     {
-        free(io_buf);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
         return res;
     }
 
-    free(io_buf);
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
     return result;
 }
 
-int IOSUHAX_FSA_CloseDir(int fsaFd, int handle)
+int IOSUHAX_Ctx_FSA_CloseDir(iosuhax_ctx_t *ctx, int fsaFd, int handle)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     const int input_cnt = 2;
 
     int io_buf_size = sizeof(uint32_t) * input_cnt;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
@@ -467,169 +979,377 @@ int IOSUHAX_FSA_CloseDir(int fsaFd, int handle)
 
     int result;
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_CLOSEDIR, io_buf, io_buf_size, &result, sizeof(result));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_CLOSEDIR, io_buf, io_buf_size, &result, sizeof(result));
     if(res < 0)
     {
-        free(io_buf);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
         return res;
     }
 
-    free(io_buf);
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
     return result;
 }
 
-int IOSUHAX_FSA_ChangeDir(int fsaFd, const char *path)
+int iosuhax_fsa_change_dir(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char *path)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    uint32_t path_len = iosuhax_path_len(prefix, path);
 
     const int input_cnt = 2;
 
-    int io_buf_size = sizeof(uint32_t) * input_cnt + strlen(path) + 1;
+    int io_buf_size = sizeof(uint32_t) * input_cnt + path_len + 1;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
     io_buf[0] = fsaFd;
     io_buf[1] = sizeof(uint32_t) * input_cnt;
-    strcpy(((char*)io_buf) + io_buf[1], path);
+    iosuhax_path_copy(((char*)io_buf) + io_buf[1], prefix, path);
 
     int result;
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_CHDIR, io_buf, io_buf_size, &result, sizeof(result));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_CHDIR, io_buf, io_buf_size, &result, sizeof(result));
     if(res < 0)
     {
-        free(io_buf);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
         return res;
     }
 
-    free(io_buf);
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
     return result;
 }
 
-int IOSUHAX_FSA_OpenFile(int fsaFd, const char* path, const char* mode, int* outHandle)
+int IOSUHAX_Ctx_FSA_ChangeDir(iosuhax_ctx_t *ctx, int fsaFd, const char *path)
+{
+    return iosuhax_fsa_change_dir(ctx, fsaFd, NULL, path);
+}
+
+int iosuhax_fsa_open_file(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char* path, const char* mode, int* outHandle)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    uint32_t path_len = iosuhax_path_len(prefix, path);
 
     const int input_cnt = 3;
 
-    int io_buf_size = sizeof(uint32_t) * input_cnt + strlen(path) + strlen(mode) + 2;
+    int io_buf_size = sizeof(uint32_t) * input_cnt + path_len + strlen(mode) + 2;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
     io_buf[0] = fsaFd;
     io_buf[1] = sizeof(uint32_t) * input_cnt;
-    io_buf[2] = io_buf[1] + strlen(path) + 1;
-    strcpy(((char*)io_buf) + io_buf[1],  path);
+    io_buf[2] = io_buf[1] + path_len + 1;
+    iosuhax_path_copy(((char*)io_buf) + io_buf[1], prefix, path);
     strcpy(((char*)io_buf) + io_buf[2],  mode);
 
     int result_vec[2];
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_OPENFILE, io_buf, io_buf_size, result_vec, sizeof(result_vec));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_OPENFILE, io_buf, io_buf_size, result_vec, sizeof(result_vec));
     if(res < 0)
     {
-        free(io_buf);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
         return res;
     }
 
     *outHandle = result_vec[1];
-    free(io_buf);
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
     return result_vec[0];
 }
 
-int IOSUHAX_FSA_ReadFile(int fsaFd, void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags)
+int IOSUHAX_Ctx_FSA_OpenFile(iosuhax_ctx_t *ctx, int fsaFd, const char* path, const char* mode, int* outHandle)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    return iosuhax_fsa_open_file(ctx, fsaFd, NULL, path, mode, outHandle);
+}
 
+//! Reads through a bounce buffer of at most one transfer chunk, so the memory needed stays the
+//! same no matter how large the request is.
+static int IOSUHAX_FSA_ReadFileCopy(iosuhax_ctx_t *ctx, int fsaFd, void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags)
+{
     const int input_cnt = 5;
 
-    int io_buf_size = sizeof(uint32_t) * input_cnt;
+    if(!size || !cnt)
+        return 0;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
-    if(!io_buf)
+    //! elements larger than a chunk are read as bytes and counted back into whole elements
+    if(size > transferChunkSize)
+    {
+        int res = IOSUHAX_FSA_ReadFileCopy(ctx, fsaFd, data, 1, size * cnt, fileHandle, flags);
+        return (res < 0) ? res : (int)((uint32_t)res / size);
+    }
+
+    uint32_t chunk_cnt = transferChunkSize / size;
+    if(chunk_cnt > cnt)
+        chunk_cnt = cnt;
+
+    ALIGN(0x20) uint32_t io_buf[0x20 >> 2];
+
+    int out_buf_size = ROUNDUP(size * chunk_cnt + 0x40, 0x40);
+
+    uint32_t *out_buffer = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, out_buf_size);
+    if(!out_buffer)
         return -2;
 
+    int done = 0;
+    int res = 0;
+
+    while(cnt > 0)
+    {
+        uint32_t read_cnt = (cnt > chunk_cnt) ? chunk_cnt : cnt;
+
+        io_buf[0] = fsaFd;
+        io_buf[1] = size;
+        io_buf[2] = read_cnt;
+        io_buf[3] = fileHandle;
+        io_buf[4] = flags;
+
+        res = IOS_Ioctl(ctx->handle, IOCTL_FSA_READFILE, io_buf, sizeof(uint32_t) * input_cnt, out_buffer, ROUNDUP(size * read_cnt + 0x40, 0x40));
+        if(res >= 0)
+            res = out_buffer[0];
+
+        if(res <= 0)
+            break;
+
+        //! data is put to offset 0x40 to align the buffer output
+        memcpy(data, ((uint8_t*)out_buffer) + 0x40, res * size);
+
+        data = ((uint8_t*)data) + res * size;
+        done += res;
+        cnt -= res;
+
+        if((uint32_t)res < read_cnt)
+            break;
+    }
+
+    iosuhax_pool_free(&ctx->pool, out_buffer, out_buf_size);
+
+    if(res < 0 && done == 0)
+        return res;
+
+    return done;
+}
+
+//! IOSU puts the result header to offset 0 of the output buffer and the data to offset 0x40.
+//! For a cache aligned caller buffer the first 0x40 bytes worth of elements are read through
+//! the copy path and the rest is read in place, with the header landing in the space that the
+//! head elements are copied to afterwards. Costs one extra ioctl but no bounce buffer.
+static int IOSUHAX_FSA_ReadFileDirect(iosuhax_ctx_t *ctx, int fsaFd, void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags)
+{
+    uint32_t head_cnt = (0x40 + size - 1) / size;
+    uint32_t head_size = head_cnt * size;
+
+    ALIGN(0x40) uint8_t head_buf[FSA_DIRECT_IO_HEAD_MAX];
+
+    int head_res = IOSUHAX_FSA_ReadFileCopy(ctx, fsaFd, head_buf, size, head_cnt, fileHandle, flags);
+    if(head_res <= 0)
+        return head_res;
+
+    if((uint32_t)head_res < head_cnt)
+    {
+        memcpy(data, head_buf, head_res * size);
+        return head_res;
+    }
+
+    const int input_cnt = 5;
+
+    ALIGN(0x20) uint32_t io_buf[0x20 >> 2];
     io_buf[0] = fsaFd;
     io_buf[1] = size;
-    io_buf[2] = cnt;
+    io_buf[2] = cnt - head_cnt;
     io_buf[3] = fileHandle;
     io_buf[4] = flags;
 
-    int out_buf_size = ((size * cnt + 0x40) + 0x3F) & ~0x3F;
+    uint32_t *out_buffer = (uint32_t*)(((uint8_t*)data) + head_size - 0x40);
+    int out_buf_size = 0x40 + (cnt - head_cnt) * size;
 
-    uint32_t *out_buffer = (uint32_t*)memalign(0x40, out_buf_size);
-    if(!out_buffer)
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_READFILE, io_buf, sizeof(uint32_t) * input_cnt, out_buffer, out_buf_size);
+    if(res >= 0)
+        res = out_buffer[0];
+
+    //! restore the head elements over the result header
+    memcpy(data, head_buf, head_size);
+
+    if(res < 0)
+        return head_res;
+
+    return head_res + res;
+}
+
+int IOSUHAX_Ctx_FSA_ReadFile(iosuhax_ctx_t *ctx, int fsaFd, void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    //! the byte count has to fit 32 bit, larger requests end in a short read
+    if(size && cnt > 0xFFFFFFFF / size)
+        cnt = 0xFFFFFFFF / size;
+
+    uint32_t total_size = size * cnt;
+
+    if(    !flags
+        && size && size <= FSA_DIRECT_IO_HEAD_MAX
+        && total_size >= FSA_DIRECT_IO_MIN_SIZE
+        && !((uintptr_t)data & 0x3F) && !(total_size & 0x3F)
+        && !((((0x40 + size - 1) / size) * size) & 0x3F))
     {
-        free(io_buf);
-        return -2;
+        return IOSUHAX_FSA_ReadFileDirect(ctx, fsaFd, data, size, cnt, fileHandle, flags);
     }
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_READFILE, io_buf, io_buf_size, out_buffer, out_buf_size);
-    if(res < 0)
+    return IOSUHAX_FSA_ReadFileCopy(ctx, fsaFd, data, size, cnt, fileHandle, flags);
+}
+
+//! Gathers the segments into a bounce buffer of at most one transfer chunk and writes
+//! it out chunk by chunk. Returns the number of elements of 'size' bytes written.
+static int IOSUHAX_FSA_WriteFileGather(iosuhax_ctx_t *ctx, int fsaFd, const fileSegment_s *segments, uint32_t seg_cnt, uint32_t size, int fileHandle, uint32_t flags)
+{
+    const int input_cnt = 5;
+
+    uint32_t total_size = 0;
+    uint32_t i;
+
+    for(i = 0; i < seg_cnt; i++)
+        total_size += segments[i].size;
+
+    if(!size || !total_size)
+        return 0;
+
+    //! elements larger than a chunk are written as bytes and counted back into whole elements
+    if(size > transferChunkSize)
     {
-        free(out_buffer);
-        free(io_buf);
-        return res;
+        int res = IOSUHAX_FSA_WriteFileGather(ctx, fsaFd, segments, seg_cnt, 1, fileHandle, flags);
+        return (res < 0) ? res : (int)((uint32_t)res / size);
     }
 
-    //! data is put to offset 0x40 to align the buffer output
-    memcpy(data, ((uint8_t*)out_buffer) + 0x40, size * cnt);
+    uint32_t chunk_cnt = transferChunkSize / size;
 
-    int result = out_buffer[0];
+    uint32_t chunk_size = chunk_cnt * size;
+    if(chunk_size > total_size)
+        chunk_size = total_size;
 
-    free(out_buffer);
-    free(io_buf);
-    return result;
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, ROUNDUP(chunk_size + 0x40, 0x40));
+    if(!io_buf)
+        return -2;
+
+    uint32_t seg_idx = 0;
+    uint32_t seg_offset = 0;
+    int done = 0;
+    int res = 0;
+
+    while(seg_idx < seg_cnt)
+    {
+        uint32_t filled = 0;
+
+        //! data is put to offset 0x40 to align the buffer input
+        while(filled < chunk_size && seg_idx < seg_cnt)
+        {
+            uint32_t copy_size = segments[seg_idx].size - seg_offset;
+            if(copy_size > chunk_size - filled)
+                copy_size = chunk_size - filled;
+
+            memcpy(((uint8_t*)io_buf) + 0x40 + filled, ((const uint8_t*)segments[seg_idx].data) + seg_offset, copy_size);
+            filled += copy_size;
+            seg_offset += copy_size;
+
+            if(seg_offset == segments[seg_idx].size)
+            {
+                seg_idx++;
+                seg_offset = 0;
+            }
+        }
+
+        uint32_t cnt = filled / size;
+
+        io_buf[0] = fsaFd;
+        io_buf[1] = size;
+        io_buf[2] = cnt;
+        io_buf[3] = fileHandle;
+        io_buf[4] = flags;
+
+        int result;
+        res = IOS_Ioctl(ctx->handle, IOCTL_FSA_WRITEFILE, io_buf, ROUNDUP(filled + 0x40, 0x40), &result, sizeof(result));
+        if(res >= 0)
+            res = result;
+
+        if(res < 0)
+            break;
+
+        done += res;
+
+        if((uint32_t)res < cnt)
+            break;
+    }
+
+    iosuhax_pool_free(&ctx->pool, io_buf, ROUNDUP(chunk_size + 0x40, 0x40));
+
+    if(res < 0 && done == 0)
+        return res;
+
+    return done;
 }
 
-int IOSUHAX_FSA_WriteFile(int fsaFd, const void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags)
+int IOSUHAX_Ctx_FSA_WriteFile(iosuhax_ctx_t *ctx, int fsaFd, const void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
-    const int input_cnt = 5;
+    //! the byte count has to fit 32 bit, larger requests end in a short write
+    if(size && cnt > 0xFFFFFFFF / size)
+        cnt = 0xFFFFFFFF / size;
 
-    int io_buf_size = ((sizeof(uint32_t) * input_cnt + size * cnt + 0x40) + 0x3F) & ~0x3F;
+    fileSegment_s segment;
+    segment.data = data;
+    segment.size = size * cnt;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
-    if(!io_buf)
-        return -2;
+    return IOSUHAX_FSA_WriteFileGather(ctx, fsaFd, &segment, 1, size, fileHandle, flags);
+}
+
+int IOSUHAX_Ctx_FSA_WriteFileV(iosuhax_ctx_t *ctx, int fsaFd, const fileSegment_s *segments, uint32_t seg_cnt, int fileHandle, uint32_t flags)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    return IOSUHAX_FSA_WriteFileGather(ctx, fsaFd, segments, seg_cnt, 1, fileHandle, flags);
+}
+
+int IOSUHAX_Ctx_FSA_WriteFileInPlace(iosuhax_ctx_t *ctx, int fsaFd, void* buffer, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    if(((uintptr_t)buffer & 0x3F) || !size || cnt > (0xFFFFFFFF - IOSUHAX_FSA_IO_HEADER_SIZE) / size)
+        return IOS_ERROR_INVALID_ARG;
 
+    //! the header is written to the reserved space in front of the payload, no copy needed
+    uint32_t *io_buf = (uint32_t*)buffer;
     io_buf[0] = fsaFd;
     io_buf[1] = size;
     io_buf[2] = cnt;
     io_buf[3] = fileHandle;
     io_buf[4] = flags;
 
-    //! data is put to offset 0x40 to align the buffer input
-    memcpy(((uint8_t*)io_buf) + 0x40, data, size * cnt);
-
     int result;
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_WRITEFILE, io_buf, io_buf_size, &result, sizeof(result));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_WRITEFILE, io_buf, IOSUHAX_FSA_IO_HEADER_SIZE + size * cnt, &result, sizeof(result));
     if(res < 0)
-    {
-        free(io_buf);
         return res;
-    }
-    free(io_buf);
+
     return result;
 }
 
-int IOSUHAX_FSA_StatFile(int fsaFd, int fileHandle, fileStat_s* out_data)
+int IOSUHAX_Ctx_FSA_StatFile(iosuhax_ctx_t *ctx, int fsaFd, int fileHandle, fileStat_s* out_data)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     const int input_cnt = 2;
 
     int io_buf_size = sizeof(uint32_t) * input_cnt;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
@@ -637,39 +1357,39 @@ int IOSUHAX_FSA_StatFile(int fsaFd, int fileHandle, fileStat_s* out_data)
     io_buf[1] = fileHandle;
 
     int out_buf_size = 4 + sizeof(fileStat_s);
-    uint32_t *out_buffer = (uint32_t*)memalign(0x20, out_buf_size);
+    uint32_t *out_buffer = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, out_buf_size);
     if(!out_buffer)
     {
-        free(io_buf);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
         return -2;
     }
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_STATFILE, io_buf, io_buf_size, out_buffer, out_buf_size);
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_STATFILE, io_buf, io_buf_size, out_buffer, out_buf_size);
     if(res < 0)
     {
-        free(io_buf);
-        free(out_buffer);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
+        iosuhax_pool_free(&ctx->pool, out_buffer, out_buf_size);
         return res;
     }
 
     int result = out_buffer[0];
     memcpy(out_data, out_buffer + 1, sizeof(fileStat_s));
 
-    free(io_buf);
-    free(out_buffer);
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
+    iosuhax_pool_free(&ctx->pool, out_buffer, out_buf_size);
     return result;
 }
 
-int IOSUHAX_FSA_CloseFile(int fsaFd, int fileHandle)
+int IOSUHAX_Ctx_FSA_CloseFile(iosuhax_ctx_t *ctx, int fsaFd, int fileHandle)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     const int input_cnt = 2;
 
     int io_buf_size = sizeof(uint32_t) * input_cnt;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
@@ -678,27 +1398,27 @@ int IOSUHAX_FSA_CloseFile(int fsaFd, int fileHandle)
 
     int result;
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_CLOSEFILE, io_buf, io_buf_size, &result, sizeof(result));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_CLOSEFILE, io_buf, io_buf_size, &result, sizeof(result));
     if(res < 0)
     {
-        free(io_buf);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
         return res;
     }
 
-    free(io_buf);
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
     return result;
 }
 
-int IOSUHAX_FSA_SetFilePos(int fsaFd, int fileHandle, uint32_t position)
+int IOSUHAX_Ctx_FSA_SetFilePos(iosuhax_ctx_t *ctx, int fsaFd, int fileHandle, uint32_t position)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     const int input_cnt = 3;
 
     int io_buf_size = sizeof(uint32_t) * input_cnt;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
@@ -708,110 +1428,167 @@ int IOSUHAX_FSA_SetFilePos(int fsaFd, int fileHandle, uint32_t position)
 
     int result;
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_SETFILEPOS, io_buf, io_buf_size, &result, sizeof(result));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_SETFILEPOS, io_buf, io_buf_size, &result, sizeof(result));
     if(res < 0)
     {
-        free(io_buf);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
         return res;
     }
 
-    free(io_buf);
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
     return result;
 }
 
-int IOSUHAX_FSA_GetStat(int fsaFd, const char *path, fileStat_s* out_data)
+int iosuhax_fsa_get_stat(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char *path, fileStat_s* out_data)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    uint32_t path_len = iosuhax_path_len(prefix, path);
 
     const int input_cnt = 2;
 
-    int io_buf_size = sizeof(uint32_t) * input_cnt + strlen(path) + 1;
+    int io_buf_size = sizeof(uint32_t) * input_cnt + path_len + 1;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, io_buf_size);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
     io_buf[0] = fsaFd;
     io_buf[1] = sizeof(uint32_t) * input_cnt;
-    strcpy(((char*)io_buf) + io_buf[1], path);
+    iosuhax_path_copy(((char*)io_buf) + io_buf[1], prefix, path);
 
     int out_buf_size = 4 + sizeof(fileStat_s);
-    uint32_t *out_buffer = (uint32_t*)memalign(0x20, out_buf_size);
+    uint32_t *out_buffer = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, out_buf_size);
     if(!out_buffer)
     {
-        free(io_buf);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
         return -2;
     }
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_GETSTAT, io_buf, io_buf_size, out_buffer, out_buf_size);
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_GETSTAT, io_buf, io_buf_size, out_buffer, out_buf_size);
     if(res < 0)
     {
-        free(io_buf);
-        free(out_buffer);
+        iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
+        iosuhax_pool_free(&ctx->pool, out_buffer, out_buf_size);
         return res;
     }
 
     int result = out_buffer[0];
     memcpy(out_data, out_buffer + 1, sizeof(fileStat_s));
 
-    free(io_buf);
-    free(out_buffer);
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
+    iosuhax_pool_free(&ctx->pool, out_buffer, out_buf_size);
     return result;
 }
 
-int IOSUHAX_FSA_Remove(int fsaFd, const char *path)
+int IOSUHAX_Ctx_FSA_GetStat(iosuhax_ctx_t *ctx, int fsaFd, const char *path, fileStat_s* out_data)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    return iosuhax_fsa_get_stat(ctx, fsaFd, NULL, path, out_data);
+}
+
+int iosuhax_fsa_remove(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char *path)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    uint32_t path_len = iosuhax_path_len(prefix, path);
 
     const int input_cnt = 2;
 
-    int io_buf_size = sizeof(uint32_t) * input_cnt + strlen(path) + 1;
+    int io_buf_size = sizeof(uint32_t) * input_cnt + path_len + 1;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x20, ROUNDUP(io_buf_size, 0x20));
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, ROUNDUP(io_buf_size, 0x20));
     if(!io_buf)
         return -2;
 
     io_buf[0] = fsaFd;
     io_buf[1] = sizeof(uint32_t) * input_cnt;
-    strcpy(((char*)io_buf) + io_buf[1], path);
+    iosuhax_path_copy(((char*)io_buf) + io_buf[1], prefix, path);
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_REMOVE, io_buf, io_buf_size, io_buf, 4);
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_REMOVE, io_buf, io_buf_size, io_buf, 4);
     if(res >= 0)
        res = io_buf[0];
 
-    free(io_buf);
+    iosuhax_pool_free(&ctx->pool, io_buf, ROUNDUP(io_buf_size, 0x20));
     return res;
 }
 
-int IOSUHAX_FSA_ChangeMode(int fsaFd, const char* path, int mode)
+int IOSUHAX_Ctx_FSA_Remove(iosuhax_ctx_t *ctx, int fsaFd, const char *path)
+{
+    return iosuhax_fsa_remove(ctx, fsaFd, NULL, path);
+}
+
+//! both paths get the same prefix
+int iosuhax_fsa_rename(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char *old_path, const char *new_path)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    uint32_t old_path_len = iosuhax_path_len(prefix, old_path);
+    uint32_t new_path_len = iosuhax_path_len(prefix, new_path);
 
     const int input_cnt = 3;
 
-    int io_buf_size = sizeof(uint32_t) * input_cnt + strlen(path) + 1;
+    int io_buf_size = sizeof(uint32_t) * input_cnt + old_path_len + new_path_len + 2;
+
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, ROUNDUP(io_buf_size, 0x20));
+    if(!io_buf)
+        return -2;
+
+    io_buf[0] = fsaFd;
+    io_buf[1] = sizeof(uint32_t) * input_cnt;
+    io_buf[2] = io_buf[1] + old_path_len + 1;
+    iosuhax_path_copy(((char*)io_buf) + io_buf[1], prefix, old_path);
+    iosuhax_path_copy(((char*)io_buf) + io_buf[2], prefix, new_path);
+
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_RENAME, io_buf, io_buf_size, io_buf, 4);
+    if(res >= 0)
+       res = io_buf[0];
+
+    iosuhax_pool_free(&ctx->pool, io_buf, ROUNDUP(io_buf_size, 0x20));
+    return res;
+}
+
+int IOSUHAX_Ctx_FSA_Rename(iosuhax_ctx_t *ctx, int fsaFd, const char *old_path, const char *new_path)
+{
+    return iosuhax_fsa_rename(ctx, fsaFd, NULL, old_path, new_path);
+}
+
+int iosuhax_fsa_change_mode(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char* path, int mode)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    uint32_t path_len = iosuhax_path_len(prefix, path);
+
+    const int input_cnt = 3;
+
+    int io_buf_size = sizeof(uint32_t) * input_cnt + path_len + 1;
 
     ALIGN(0x20) uint32_t io_buf[ROUNDUP(io_buf_size, 0x20) >> 2];
 
     io_buf[0] = fsaFd;
     io_buf[1] = sizeof(uint32_t) * input_cnt;
     io_buf[2] = mode;
-    strcpy(((char*)io_buf) + io_buf[1], path);
+    iosuhax_path_copy(((char*)io_buf) + io_buf[1], prefix, path);
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_CHANGEMODE, io_buf, io_buf_size, io_buf, 4);
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_CHANGEMODE, io_buf, io_buf_size, io_buf, 4);
     if(res < 0)
        return res;
 
     return io_buf[0];
 }
 
-int IOSUHAX_FSA_RawOpen(int fsaFd, const char* device_path, int* outHandle)
+int IOSUHAX_Ctx_FSA_ChangeMode(iosuhax_ctx_t *ctx, int fsaFd, const char* path, int mode)
+{
+    return iosuhax_fsa_change_mode(ctx, fsaFd, NULL, path, mode);
+}
+
+int IOSUHAX_Ctx_FSA_RawOpen(iosuhax_ctx_t *ctx, int fsaFd, const char* device_path, int* outHandle)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     const int input_cnt = 2;
 
@@ -823,7 +1600,7 @@ int IOSUHAX_FSA_RawOpen(int fsaFd, const char* device_path, int* outHandle)
     io_buf[1] = sizeof(uint32_t) * input_cnt;
     strcpy(((char*)io_buf) + io_buf[1], device_path);
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_RAW_OPEN, io_buf, io_buf_size, io_buf, 2 * sizeof(int));
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_RAW_OPEN, io_buf, io_buf_size, io_buf, 2 * sizeof(int));
     if(res < 0)
         return res;
 
@@ -833,50 +1610,119 @@ int IOSUHAX_FSA_RawOpen(int fsaFd, const char* device_path, int* outHandle)
     return io_buf[0];
 }
 
-int IOSUHAX_FSA_RawRead(int fsaFd, void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle)
+int IOSUHAX_Ctx_FSA_RawRead(iosuhax_ctx_t *ctx, int fsaFd, void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    //! a block can not be split across chunks
+    if(!block_size || block_size > transferChunkSize)
+        return IOS_ERROR_INVALID_SIZE;
 
     const int input_cnt = 6;
 
-    int io_buf_size = 0x40 + block_size * block_cnt;
-    uint32_t *io_buf = (uint32_t*)memalign(0x40, ROUNDUP(io_buf_size, 0x40));
+    uint32_t chunk_blocks = transferChunkSize / block_size;
+    if(chunk_blocks > block_cnt)
+        chunk_blocks = block_cnt;
+
+    int io_buf_size = ROUNDUP(0x40 + block_size * chunk_blocks, 0x40);
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
 
     if(!io_buf)
         return -2;
 
-    io_buf[0] = fsaFd;
-    io_buf[1] = block_size;
-    io_buf[2] = block_cnt;
-    io_buf[3] = (sector_offset >> 32) & 0xFFFFFFFF;
-    io_buf[4] = sector_offset & 0xFFFFFFFF;
-    io_buf[5] = device_handle;
+    int res = 0;
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_RAW_READ, io_buf, sizeof(uint32_t) * input_cnt, io_buf, io_buf_size);
-    if(res >= 0)
+    do
     {
-        //! data is put to offset 0x40 to align the buffer output
-        memcpy(data, ((uint8_t*)io_buf) + 0x40, block_size * block_cnt);
+        uint32_t blocks = (block_cnt > chunk_blocks) ? chunk_blocks : block_cnt;
+
+        io_buf[0] = fsaFd;
+        io_buf[1] = block_size;
+        io_buf[2] = blocks;
+        io_buf[3] = (sector_offset >> 32) & 0xFFFFFFFF;
+        io_buf[4] = sector_offset & 0xFFFFFFFF;
+        io_buf[5] = device_handle;
 
-        res = io_buf[0];
+        res = IOS_Ioctl(ctx->handle, IOCTL_FSA_RAW_READ, io_buf, sizeof(uint32_t) * input_cnt, io_buf, 0x40 + block_size * blocks);
+        if(res >= 0)
+        {
+            //! data is put to offset 0x40 to align the buffer output
+            memcpy(data, ((uint8_t*)io_buf) + 0x40, block_size * blocks);
+
+            res = io_buf[0];
+        }
+
+        data = ((uint8_t*)data) + block_size * blocks;
+        sector_offset += blocks;
+        block_cnt -= blocks;
     }
+    while(res >= 0 && block_cnt > 0);
 
-    free(io_buf);
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
     return res;
 }
 
-int IOSUHAX_FSA_RawWrite(int fsaFd, const void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle)
+int IOSUHAX_Ctx_FSA_RawWrite(iosuhax_ctx_t *ctx, int fsaFd, const void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    //! a block can not be split across chunks
+    if(!block_size || block_size > transferChunkSize)
+        return IOS_ERROR_INVALID_SIZE;
 
-    int io_buf_size = ROUNDUP(0x40 + block_size * block_cnt, 0x40);
+    uint32_t chunk_blocks = transferChunkSize / block_size;
+    if(chunk_blocks > block_cnt)
+        chunk_blocks = block_cnt;
 
-    uint32_t *io_buf = (uint32_t*)memalign(0x40, io_buf_size);
+    int io_buf_size = ROUNDUP(0x40 + block_size * chunk_blocks, 0x40);
+
+    uint32_t *io_buf = (uint32_t*)iosuhax_pool_alloc(&ctx->pool, io_buf_size);
     if(!io_buf)
         return -2;
 
+    int res = 0;
+
+    do
+    {
+        uint32_t blocks = (block_cnt > chunk_blocks) ? chunk_blocks : block_cnt;
+
+        io_buf[0] = fsaFd;
+        io_buf[1] = block_size;
+        io_buf[2] = blocks;
+        io_buf[3] = (sector_offset >> 32) & 0xFFFFFFFF;
+        io_buf[4] = sector_offset & 0xFFFFFFFF;
+        io_buf[5] = device_handle;
+
+        //! data is put to offset 0x40 to align the buffer input
+        memcpy(((uint8_t*)io_buf) + 0x40, data, block_size * blocks);
+
+        res = IOS_Ioctl(ctx->handle, IOCTL_FSA_RAW_WRITE, io_buf, ROUNDUP(0x40 + block_size * blocks, 0x40), io_buf, 4);
+        if(res >= 0)
+           res = io_buf[0];
+
+        data = ((const uint8_t*)data) + block_size * blocks;
+        sector_offset += blocks;
+        block_cnt -= blocks;
+    }
+    while(res >= 0 && block_cnt > 0);
+
+    iosuhax_pool_free(&ctx->pool, io_buf, io_buf_size);
+    return res;
+}
+
+
+int IOSUHAX_Ctx_FSA_RawWriteInPlace(iosuhax_ctx_t *ctx, int fsaFd, void* buffer, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    if(((uintptr_t)buffer & 0x3F) || !block_size || block_cnt > (0xFFFFFFFF - IOSUHAX_FSA_IO_HEADER_SIZE) / block_size)
+        return IOS_ERROR_INVALID_ARG;
+
+    //! the header is written to the reserved space in front of the payload, no copy needed
+    uint32_t *io_buf = (uint32_t*)buffer;
     io_buf[0] = fsaFd;
     io_buf[1] = block_size;
     io_buf[2] = block_cnt;
@@ -884,22 +1730,17 @@ int IOSUHAX_FSA_RawWrite(int fsaFd, const void* data, uint32_t block_size, uint3
     io_buf[4] = sector_offset & 0xFFFFFFFF;
     io_buf[5] = device_handle;
 
-    //! data is put to offset 0x40 to align the buffer input
-    memcpy(((uint8_t*)io_buf) + 0x40, data, block_size * block_cnt);
-
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_RAW_WRITE, io_buf, io_buf_size, io_buf, 4);
-    if(res >= 0)
-       res = io_buf[0];
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_RAW_WRITE, io_buf, IOSUHAX_FSA_IO_HEADER_SIZE + block_size * block_cnt, io_buf, 4);
+    if(res < 0)
+        return res;
 
-    free(io_buf);
-    return res;
+    return io_buf[0];
 }
 
-
-int IOSUHAX_FSA_RawClose(int fsaFd, int device_handle)
+int IOSUHAX_Ctx_FSA_RawClose(iosuhax_ctx_t *ctx, int fsaFd, int device_handle)
 {
-    if(iosuhaxHandle < 0)
-        return iosuhaxHandle;
+    if(ctx->handle < 0)
+        return ctx->handle;
 
     const int input_cnt = 2;
 
@@ -910,9 +1751,227 @@ int IOSUHAX_FSA_RawClose(int fsaFd, int device_handle)
     io_buf[0] = fsaFd;
     io_buf[1] = device_handle;
 
-    int res = IOS_Ioctl(iosuhaxHandle, IOCTL_FSA_RAW_CLOSE, io_buf, io_buf_size, io_buf, 4);
+    int res = IOS_Ioctl(ctx->handle, IOCTL_FSA_RAW_CLOSE, io_buf, io_buf_size, io_buf, 4);
     if(res < 0)
        return res;
 
     return io_buf[0];
 }
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! default context
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int IOSUHAX_memwrite(uint32_t address, const uint8_t * buffer, uint32_t size)
+{
+    return IOSUHAX_Ctx_memwrite(&defaultCtx, address, buffer, size);
+}
+
+int IOSUHAX_memread(uint32_t address, uint8_t * out_buffer, uint32_t size)
+{
+    return IOSUHAX_Ctx_memread(&defaultCtx, address, out_buffer, size);
+}
+
+int IOSUHAX_memreadv(const memVector_s *vec, uint32_t vec_cnt)
+{
+    return IOSUHAX_Ctx_memreadv(&defaultCtx, vec, vec_cnt);
+}
+
+int IOSUHAX_memwritev(const memVector_s *vec, uint32_t vec_cnt)
+{
+    return IOSUHAX_Ctx_memwritev(&defaultCtx, vec, vec_cnt);
+}
+
+int IOSUHAX_memcpy(uint32_t dst, uint32_t src, uint32_t size)
+{
+    return IOSUHAX_Ctx_memcpy(&defaultCtx, dst, src, size);
+}
+
+int IOSUHAX_memfill(uint32_t address, const void *pattern, uint32_t pattern_size, uint32_t size)
+{
+    return IOSUHAX_Ctx_memfill(&defaultCtx, address, pattern, pattern_size, size);
+}
+
+int IOSUHAX_memset(uint32_t address, uint8_t value, uint32_t size)
+{
+    return IOSUHAX_Ctx_memset(&defaultCtx, address, value, size);
+}
+
+int IOSUHAX_kern_read32(uint32_t address, uint32_t *out_buffer, uint32_t count)
+{
+    return IOSUHAX_Ctx_kern_read32(&defaultCtx, address, out_buffer, count);
+}
+
+int IOSUHAX_kern_write32(uint32_t address, uint32_t value)
+{
+    return IOSUHAX_Ctx_kern_write32(&defaultCtx, address, value);
+}
+
+int IOSUHAX_kern_read32v(const uint32_t *addresses, uint32_t *values, uint32_t count)
+{
+    return IOSUHAX_Ctx_kern_read32v(&defaultCtx, addresses, values, count);
+}
+
+int IOSUHAX_kern_write32v(const uint32_t *addresses, const uint32_t *values, uint32_t count)
+{
+    return IOSUHAX_Ctx_kern_write32v(&defaultCtx, addresses, values, count);
+}
+
+int IOSUHAX_SVC(uint32_t svc_id, uint32_t * args, uint32_t arg_cnt)
+{
+    return IOSUHAX_Ctx_SVC(&defaultCtx, svc_id, args, arg_cnt);
+}
+
+int IOSUHAX_SVC_Batch(const svcCall_s *calls, uint32_t call_cnt, int *results, int stop_on_error)
+{
+    return IOSUHAX_Ctx_SVC_Batch(&defaultCtx, calls, call_cnt, results, stop_on_error);
+}
+
+int IOSUHAX_FSA_Open(void)
+{
+    return IOSUHAX_Ctx_FSA_Open(&defaultCtx);
+}
+
+int IOSUHAX_FSA_Close(int fsaFd)
+{
+    return IOSUHAX_Ctx_FSA_Close(&defaultCtx, fsaFd);
+}
+
+int IOSUHAX_FSA_Mount(int fsaFd, const char* device_path, const char* volume_path, uint32_t flags, const char* arg_string, int arg_string_len)
+{
+    return IOSUHAX_Ctx_FSA_Mount(&defaultCtx, fsaFd, device_path, volume_path, flags, arg_string, arg_string_len);
+}
+
+int IOSUHAX_FSA_Unmount(int fsaFd, const char* path, uint32_t flags)
+{
+    return IOSUHAX_Ctx_FSA_Unmount(&defaultCtx, fsaFd, path, flags);
+}
+
+int IOSUHAX_FSA_FlushVolume(int fsaFd, const char *volume_path)
+{
+    return IOSUHAX_Ctx_FSA_FlushVolume(&defaultCtx, fsaFd, volume_path);
+}
+
+int IOSUHAX_FSA_GetDeviceInfo(int fsaFd, const char* device_path, int type, uint32_t* out_data)
+{
+    return IOSUHAX_Ctx_FSA_GetDeviceInfo(&defaultCtx, fsaFd, device_path, type, out_data);
+}
+
+int IOSUHAX_FSA_MakeDir(int fsaFd, const char* path, uint32_t flags)
+{
+    return IOSUHAX_Ctx_FSA_MakeDir(&defaultCtx, fsaFd, path, flags);
+}
+
+int IOSUHAX_FSA_OpenDir(int fsaFd, const char* path, int* outHandle)
+{
+    return IOSUHAX_Ctx_FSA_OpenDir(&defaultCtx, fsaFd, path, outHandle);
+}
+
+int IOSUHAX_FSA_ReadDir(int fsaFd, int handle, directoryEntry_s* out_data)
+{
+    return IOSUHAX_Ctx_FSA_ReadDir(&defaultCtx, fsaFd, handle, out_data);
+}
+
+int IOSUHAX_FSA_ReadDirMulti(int fsaFd, int handle, directoryEntry_s* out_data, uint32_t max_entries)
+{
+    return IOSUHAX_Ctx_FSA_ReadDirMulti(&defaultCtx, fsaFd, handle, out_data, max_entries);
+}
+
+int IOSUHAX_FSA_RewindDir(int fsaFd, int dirHandle)
+{
+    return IOSUHAX_Ctx_FSA_RewindDir(&defaultCtx, fsaFd, dirHandle);
+}
+
+int IOSUHAX_FSA_CloseDir(int fsaFd, int handle)
+{
+    return IOSUHAX_Ctx_FSA_CloseDir(&defaultCtx, fsaFd, handle);
+}
+
+int IOSUHAX_FSA_ChangeDir(int fsaFd, const char *path)
+{
+    return IOSUHAX_Ctx_FSA_ChangeDir(&defaultCtx, fsaFd, path);
+}
+
+int IOSUHAX_FSA_OpenFile(int fsaFd, const char* path, const char* mode, int* outHandle)
+{
+    return IOSUHAX_Ctx_FSA_OpenFile(&defaultCtx, fsaFd, path, mode, outHandle);
+}
+
+int IOSUHAX_FSA_ReadFile(int fsaFd, void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags)
+{
+    return IOSUHAX_Ctx_FSA_ReadFile(&defaultCtx, fsaFd, data, size, cnt, fileHandle, flags);
+}
+
+int IOSUHAX_FSA_WriteFile(int fsaFd, const void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags)
+{
+    return IOSUHAX_Ctx_FSA_WriteFile(&defaultCtx, fsaFd, data, size, cnt, fileHandle, flags);
+}
+
+int IOSUHAX_FSA_WriteFileV(int fsaFd, const fileSegment_s *segments, uint32_t seg_cnt, int fileHandle, uint32_t flags)
+{
+    return IOSUHAX_Ctx_FSA_WriteFileV(&defaultCtx, fsaFd, segments, seg_cnt, fileHandle, flags);
+}
+
+int IOSUHAX_FSA_WriteFileInPlace(int fsaFd, void* buffer, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags)
+{
+    return IOSUHAX_Ctx_FSA_WriteFileInPlace(&defaultCtx, fsaFd, buffer, size, cnt, fileHandle, flags);
+}
+
+int IOSUHAX_FSA_StatFile(int fsaFd, int fileHandle, fileStat_s* out_data)
+{
+    return IOSUHAX_Ctx_FSA_StatFile(&defaultCtx, fsaFd, fileHandle, out_data);
+}
+
+int IOSUHAX_FSA_CloseFile(int fsaFd, int fileHandle)
+{
+    return IOSUHAX_Ctx_FSA_CloseFile(&defaultCtx, fsaFd, fileHandle);
+}
+
+int IOSUHAX_FSA_SetFilePos(int fsaFd, int fileHandle, uint32_t position)
+{
+    return IOSUHAX_Ctx_FSA_SetFilePos(&defaultCtx, fsaFd, fileHandle, position);
+}
+
+int IOSUHAX_FSA_GetStat(int fsaFd, const char *path, fileStat_s* out_data)
+{
+    return IOSUHAX_Ctx_FSA_GetStat(&defaultCtx, fsaFd, path, out_data);
+}
+
+int IOSUHAX_FSA_Remove(int fsaFd, const char *path)
+{
+    return IOSUHAX_Ctx_FSA_Remove(&defaultCtx, fsaFd, path);
+}
+
+int IOSUHAX_FSA_Rename(int fsaFd, const char *old_path, const char *new_path)
+{
+    return IOSUHAX_Ctx_FSA_Rename(&defaultCtx, fsaFd, old_path, new_path);
+}
+
+int IOSUHAX_FSA_ChangeMode(int fsaFd, const char* path, int mode)
+{
+    return IOSUHAX_Ctx_FSA_ChangeMode(&defaultCtx, fsaFd, path, mode);
+}
+
+int IOSUHAX_FSA_RawOpen(int fsaFd, const char* device_path, int* outHandle)
+{
+    return IOSUHAX_Ctx_FSA_RawOpen(&defaultCtx, fsaFd, device_path, outHandle);
+}
+
+int IOSUHAX_FSA_RawRead(int fsaFd, void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle)
+{
+    return IOSUHAX_Ctx_FSA_RawRead(&defaultCtx, fsaFd, data, block_size, block_cnt, sector_offset, device_handle);
+}
+
+int IOSUHAX_FSA_RawWrite(int fsaFd, const void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle)
+{
+    return IOSUHAX_Ctx_FSA_RawWrite(&defaultCtx, fsaFd, data, block_size, block_cnt, sector_offset, device_handle);
+}
+
+int IOSUHAX_FSA_RawWriteInPlace(int fsaFd, void* buffer, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle)
+{
+    return IOSUHAX_Ctx_FSA_RawWriteInPlace(&defaultCtx, fsaFd, buffer, block_size, block_cnt, sector_offset, device_handle);
+}
+
+int IOSUHAX_FSA_RawClose(int fsaFd, int device_handle)
+{
+    return IOSUHAX_Ctx_FSA_RawClose(&defaultCtx, fsaFd, device_handle);
+}
@@ -57,19 +57,88 @@ typedef struct
 	char name[0x100];
 }directoryEntry_s;
 
+typedef struct
+{
+    const void *data;
+    uint32_t size; // size in bytes
+}fileSegment_s;
+
+typedef struct
+{
+    uint32_t address; // IOSU address
+    void *buffer;
+    uint32_t size;
+}memVector_s;
+
+#define SVC_MAX_ARGS                8
+
+typedef struct
+{
+    uint32_t svc_id;
+    uint32_t args[SVC_MAX_ARGS];
+    uint32_t arg_cnt;
+    uint32_t result_args; // bit n set: args[n] is the index of an earlier call in the batch whose result is passed instead
+}svcCall_s;
+
+typedef struct
+{
+    uint32_t cached; // bytes kept for reuse
+    uint32_t in_use; // bytes currently handed out
+    uint32_t high_water; // peak of cached + in_use
+    uint32_t limit; // max bytes kept for reuse
+}bufferPoolStats_s;
+
+typedef struct
+{
+    int result; // what the synchronous call would have returned
+    void *userdata;
+}completionEntry_s;
+
+typedef struct _completionQueue_s completionQueue_s;
+
+typedef struct _iosuhax_ctx_t iosuhax_ctx_t;
+
+//! receives the data of a streamed read chunk by chunk, a negative return value aborts the stream
+typedef int (*streamConsumer_t)(void *userdata, const void *data, uint32_t size);
+
 #define DIR_ENTRY_IS_DIRECTORY      0x80000000
 
+//! space the in-place writes need in front of their payload for the ioctl header
+#define IOSUHAX_FSA_IO_HEADER_SIZE  0x40
+
 #define FSA_MOUNTFLAGS_BINDMOUNT (1 << 0)
 #define FSA_MOUNTFLAGS_GLOBAL (1 << 1)
 
 int IOSUHAX_Open(const char *dev);  // if dev == NULL the default path /dev/iosuhax will be used
 int IOSUHAX_Close(void);
 
+//! copied FSA transfers are split into chunks of this size (default 128 KiB) to bound the buffer memory,
+//! raw transfers with a block size above it fail with IOS_ERROR_INVALID_SIZE
+void IOSUHAX_SetTransferChunkSize(uint32_t chunk_size);
+uint32_t IOSUHAX_GetTransferChunkSize(void);
+
+//! ioctl buffers are recycled through a pool of cache aligned buffers, released buffers are
+//! kept as long as the pool holds less than max_cached_bytes (default 384 KiB)
+void IOSUHAX_SetBufferPoolLimit(uint32_t max_cached_bytes);
+void IOSUHAX_GetBufferPoolStats(bufferPoolStats_s *stats);
+
 int IOSUHAX_memwrite(uint32_t address, const uint8_t * buffer, uint32_t size); // IOSU external input
 int IOSUHAX_memread(uint32_t address, uint8_t * out_buffer, uint32_t size);    // IOSU external output
 int IOSUHAX_memcpy(uint32_t dst, uint32_t src, uint32_t size);                 // IOSU internal memcpy only
+int IOSUHAX_memset(uint32_t address, uint8_t value, uint32_t size);            // IOSU internal fill, transfers no region data
+int IOSUHAX_memfill(uint32_t address, const void *pattern, uint32_t pattern_size, uint32_t size); // pattern_size up to 0x100
+int IOSUHAX_memreadv(const memVector_s *vec, uint32_t vec_cnt);                // nearby ranges are merged into one read
+int IOSUHAX_memwritev(const memVector_s *vec, uint32_t vec_cnt);               // contiguous ranges are merged into one write
+
+int IOSUHAX_kern_read32(uint32_t address, uint32_t *out_buffer, uint32_t count); // reads count consecutive kernel words
+int IOSUHAX_kern_write32(uint32_t address, uint32_t value);
+int IOSUHAX_kern_read32v(const uint32_t *addresses, uint32_t *values, uint32_t count);        // consecutive addresses share one request
+int IOSUHAX_kern_write32v(const uint32_t *addresses, const uint32_t *values, uint32_t count); // consecutive addresses share one request
 
 int IOSUHAX_SVC(uint32_t svc_id, uint32_t * args, uint32_t arg_cnt);
+//! runs the calls in order and stores each result, negative results stop the batch if stop_on_error is set
+//! returns the number of calls that were run
+int IOSUHAX_SVC_Batch(const svcCall_s *calls, uint32_t call_cnt, int *results, int stop_on_error);
 
 int IOSUHAX_FSA_Open();
 int IOSUHAX_FSA_Close(int fsaFd);
@@ -83,25 +152,122 @@ int IOSUHAX_FSA_GetDeviceInfo(int fsaFd, const char* device_path, int type, uint
 int IOSUHAX_FSA_MakeDir(int fsaFd, const char* path, uint32_t flags);
 int IOSUHAX_FSA_OpenDir(int fsaFd, const char* path, int* outHandle);
 int IOSUHAX_FSA_ReadDir(int fsaFd, int handle, directoryEntry_s* out_data);
+//! reads up to max_entries entries, returns the number read or the error if not even one could be read.
+//! The resident returns one entry per request, this saves the per entry buffer setup but not the IOSU round-trips.
+int IOSUHAX_FSA_ReadDirMulti(int fsaFd, int handle, directoryEntry_s* out_data, uint32_t max_entries);
 int IOSUHAX_FSA_RewindDir(int fsaFd, int dirHandle);
 int IOSUHAX_FSA_CloseDir(int fsaFd, int handle);
 int IOSUHAX_FSA_ChangeDir(int fsaFd, const char *path);
 
 int IOSUHAX_FSA_OpenFile(int fsaFd, const char* path, const char* mode, int* outHandle);
 int IOSUHAX_FSA_ReadFile(int fsaFd, void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags);
+//! WriteFile and WriteFileV copy the payload into a bounce buffer of one transfer chunk per ioctl
 int IOSUHAX_FSA_WriteFile(int fsaFd, const void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags);
+int IOSUHAX_FSA_WriteFileV(int fsaFd, const fileSegment_s* segments, uint32_t seg_cnt, int fileHandle, uint32_t flags); // returns bytes written
+//! writes without copying, buffer is 0x40 aligned and the payload starts at buffer + IOSUHAX_FSA_IO_HEADER_SIZE,
+//! the header space in front of it is overwritten
+int IOSUHAX_FSA_WriteFileInPlace(int fsaFd, void* buffer, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags);
 int IOSUHAX_FSA_StatFile(int fsaFd, int fileHandle, fileStat_s* out_data);
 int IOSUHAX_FSA_CloseFile(int fsaFd, int fileHandle);
 int IOSUHAX_FSA_SetFilePos(int fsaFd, int fileHandle, uint32_t position);
 int IOSUHAX_FSA_GetStat(int fsaFd, const char *path, fileStat_s* out_data);
 int IOSUHAX_FSA_Remove(int fsaFd, const char *path);
+int IOSUHAX_FSA_Rename(int fsaFd, const char *old_path, const char *new_path);
 int IOSUHAX_FSA_ChangeMode(int fsaFd, const char* path, int mode);
 
 int IOSUHAX_FSA_RawOpen(int fsaFd, const char* device_path, int* outHandle);
 int IOSUHAX_FSA_RawRead(int fsaFd, void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle);
+//! copies the payload into a bounce buffer of one transfer chunk per ioctl
 int IOSUHAX_FSA_RawWrite(int fsaFd, const void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle);
+//! same buffer layout as IOSUHAX_FSA_WriteFileInPlace
+int IOSUHAX_FSA_RawWriteInPlace(int fsaFd, void* buffer, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle);
 int IOSUHAX_FSA_RawClose(int fsaFd, int device_handle);
 
+//! asynchronous requests, results are delivered through a completion queue
+//! a queue holds up to max_requests requests in flight and is meant to be drained by one thread
+completionQueue_s *IOSUHAX_CreateCompletionQueue(uint32_t max_requests);
+void IOSUHAX_DestroyCompletionQueue(completionQueue_s *queue); // waits for all requests in flight
+int IOSUHAX_PollCompletion(completionQueue_s *queue, completionEntry_s *entry); // returns 1 if an entry was dequeued, 0 if none is ready
+int IOSUHAX_WaitCompletion(completionQueue_s *queue, completionEntry_s *entry); // returns 0 if nothing is in flight
+//! a request that fails to submit keeps its queue slot until the next IOSUHAX_PollCompletion/IOSUHAX_WaitCompletion
+//! a single request transfers at most IOSUHAX_GetTransferChunkSize() bytes, larger ones fail with IOS_ERROR_INVALID_SIZE
+
+//! the data buffer of a read has to stay valid until its completion is dequeued, write data is copied on submit
+int IOSUHAX_FSA_ReadFileAsync(int fsaFd, void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags, completionQueue_s *queue, void *userdata);
+int IOSUHAX_FSA_WriteFileAsync(int fsaFd, const void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags, completionQueue_s *queue, void *userdata);
+int IOSUHAX_FSA_RawReadAsync(int fsaFd, void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle, completionQueue_s *queue, void *userdata);
+int IOSUHAX_FSA_RawWriteAsync(int fsaFd, const void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle, completionQueue_s *queue, void *userdata);
+
+//! double buffered reads, the next chunk is read by IOSU while the consumer processes the current one
+//! returns the number of bytes passed to the consumer
+int IOSUHAX_FSA_ReadFileStream(int fsaFd, int fileHandle, uint32_t size, uint32_t flags, streamConsumer_t consume, void *userdata);
+int IOSUHAX_FSA_RawReadStream(int fsaFd, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle, streamConsumer_t consume, void *userdata);
+
+//! Every context owns its own IOS handle, buffer pool and FSA client handles, so independent components
+//! and threads can use the library without sharing state. The functions above use the default context,
+//! the one that IOSUHAX_Open opens.
+iosuhax_ctx_t *IOSUHAX_CtxOpen(const char *dev);    // returns NULL on failure
+int IOSUHAX_CtxClose(iosuhax_ctx_t *ctx);           // also closes all FSA handles opened through the context
+iosuhax_ctx_t *IOSUHAX_GetDefaultCtx(void);
+
+void IOSUHAX_Ctx_SetBufferPoolLimit(iosuhax_ctx_t *ctx, uint32_t max_cached_bytes);
+void IOSUHAX_Ctx_GetBufferPoolStats(iosuhax_ctx_t *ctx, bufferPoolStats_s *stats);
+
+int IOSUHAX_Ctx_memwrite(iosuhax_ctx_t *ctx, uint32_t address, const uint8_t * buffer, uint32_t size);
+int IOSUHAX_Ctx_memread(iosuhax_ctx_t *ctx, uint32_t address, uint8_t * out_buffer, uint32_t size);
+int IOSUHAX_Ctx_memreadv(iosuhax_ctx_t *ctx, const memVector_s *vec, uint32_t vec_cnt);
+int IOSUHAX_Ctx_memwritev(iosuhax_ctx_t *ctx, const memVector_s *vec, uint32_t vec_cnt);
+int IOSUHAX_Ctx_memcpy(iosuhax_ctx_t *ctx, uint32_t dst, uint32_t src, uint32_t size);
+int IOSUHAX_Ctx_memfill(iosuhax_ctx_t *ctx, uint32_t address, const void *pattern, uint32_t pattern_size, uint32_t size);
+int IOSUHAX_Ctx_memset(iosuhax_ctx_t *ctx, uint32_t address, uint8_t value, uint32_t size);
+
+int IOSUHAX_Ctx_kern_read32(iosuhax_ctx_t *ctx, uint32_t address, uint32_t *out_buffer, uint32_t count);
+int IOSUHAX_Ctx_kern_write32(iosuhax_ctx_t *ctx, uint32_t address, uint32_t value);
+int IOSUHAX_Ctx_kern_read32v(iosuhax_ctx_t *ctx, const uint32_t *addresses, uint32_t *values, uint32_t count);
+int IOSUHAX_Ctx_kern_write32v(iosuhax_ctx_t *ctx, const uint32_t *addresses, const uint32_t *values, uint32_t count);
+
+int IOSUHAX_Ctx_SVC(iosuhax_ctx_t *ctx, uint32_t svc_id, uint32_t * args, uint32_t arg_cnt);
+int IOSUHAX_Ctx_SVC_Batch(iosuhax_ctx_t *ctx, const svcCall_s *calls, uint32_t call_cnt, int *results, int stop_on_error);
+
+int IOSUHAX_Ctx_FSA_Open(iosuhax_ctx_t *ctx);
+int IOSUHAX_Ctx_FSA_Close(iosuhax_ctx_t *ctx, int fsaFd);
+int IOSUHAX_Ctx_FSA_Mount(iosuhax_ctx_t *ctx, int fsaFd, const char* device_path, const char* volume_path, uint32_t flags, const char* arg_string, int arg_string_len);
+int IOSUHAX_Ctx_FSA_Unmount(iosuhax_ctx_t *ctx, int fsaFd, const char* path, uint32_t flags);
+int IOSUHAX_Ctx_FSA_FlushVolume(iosuhax_ctx_t *ctx, int fsaFd, const char *volume_path);
+int IOSUHAX_Ctx_FSA_GetDeviceInfo(iosuhax_ctx_t *ctx, int fsaFd, const char* device_path, int type, uint32_t* out_data);
+int IOSUHAX_Ctx_FSA_MakeDir(iosuhax_ctx_t *ctx, int fsaFd, const char* path, uint32_t flags);
+int IOSUHAX_Ctx_FSA_OpenDir(iosuhax_ctx_t *ctx, int fsaFd, const char* path, int* outHandle);
+int IOSUHAX_Ctx_FSA_ReadDir(iosuhax_ctx_t *ctx, int fsaFd, int handle, directoryEntry_s* out_data);
+int IOSUHAX_Ctx_FSA_ReadDirMulti(iosuhax_ctx_t *ctx, int fsaFd, int handle, directoryEntry_s* out_data, uint32_t max_entries);
+int IOSUHAX_Ctx_FSA_RewindDir(iosuhax_ctx_t *ctx, int fsaFd, int dirHandle);
+int IOSUHAX_Ctx_FSA_CloseDir(iosuhax_ctx_t *ctx, int fsaFd, int handle);
+int IOSUHAX_Ctx_FSA_ChangeDir(iosuhax_ctx_t *ctx, int fsaFd, const char *path);
+int IOSUHAX_Ctx_FSA_OpenFile(iosuhax_ctx_t *ctx, int fsaFd, const char* path, const char* mode, int* outHandle);
+int IOSUHAX_Ctx_FSA_ReadFile(iosuhax_ctx_t *ctx, int fsaFd, void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags);
+int IOSUHAX_Ctx_FSA_WriteFile(iosuhax_ctx_t *ctx, int fsaFd, const void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags);
+int IOSUHAX_Ctx_FSA_WriteFileV(iosuhax_ctx_t *ctx, int fsaFd, const fileSegment_s *segments, uint32_t seg_cnt, int fileHandle, uint32_t flags);
+int IOSUHAX_Ctx_FSA_WriteFileInPlace(iosuhax_ctx_t *ctx, int fsaFd, void* buffer, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags);
+int IOSUHAX_Ctx_FSA_StatFile(iosuhax_ctx_t *ctx, int fsaFd, int fileHandle, fileStat_s* out_data);
+int IOSUHAX_Ctx_FSA_CloseFile(iosuhax_ctx_t *ctx, int fsaFd, int fileHandle);
+int IOSUHAX_Ctx_FSA_SetFilePos(iosuhax_ctx_t *ctx, int fsaFd, int fileHandle, uint32_t position);
+int IOSUHAX_Ctx_FSA_GetStat(iosuhax_ctx_t *ctx, int fsaFd, const char *path, fileStat_s* out_data);
+int IOSUHAX_Ctx_FSA_Remove(iosuhax_ctx_t *ctx, int fsaFd, const char *path);
+int IOSUHAX_Ctx_FSA_Rename(iosuhax_ctx_t *ctx, int fsaFd, const char *old_path, const char *new_path);
+int IOSUHAX_Ctx_FSA_ChangeMode(iosuhax_ctx_t *ctx, int fsaFd, const char* path, int mode);
+int IOSUHAX_Ctx_FSA_RawOpen(iosuhax_ctx_t *ctx, int fsaFd, const char* device_path, int* outHandle);
+int IOSUHAX_Ctx_FSA_RawRead(iosuhax_ctx_t *ctx, int fsaFd, void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle);
+int IOSUHAX_Ctx_FSA_RawWrite(iosuhax_ctx_t *ctx, int fsaFd, const void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle);
+int IOSUHAX_Ctx_FSA_RawWriteInPlace(iosuhax_ctx_t *ctx, int fsaFd, void* buffer, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle);
+int IOSUHAX_Ctx_FSA_RawClose(iosuhax_ctx_t *ctx, int fsaFd, int device_handle);
+
+int IOSUHAX_Ctx_FSA_ReadFileAsync(iosuhax_ctx_t *ctx, int fsaFd, void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags, completionQueue_s *queue, void *userdata);
+int IOSUHAX_Ctx_FSA_WriteFileAsync(iosuhax_ctx_t *ctx, int fsaFd, const void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags, completionQueue_s *queue, void *userdata);
+int IOSUHAX_Ctx_FSA_RawReadAsync(iosuhax_ctx_t *ctx, int fsaFd, void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle, completionQueue_s *queue, void *userdata);
+int IOSUHAX_Ctx_FSA_RawWriteAsync(iosuhax_ctx_t *ctx, int fsaFd, const void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle, completionQueue_s *queue, void *userdata);
+
+int IOSUHAX_Ctx_FSA_ReadFileStream(iosuhax_ctx_t *ctx, int fsaFd, int fileHandle, uint32_t size, uint32_t flags, streamConsumer_t consume, void *userdata);
+int IOSUHAX_Ctx_FSA_RawReadStream(iosuhax_ctx_t *ctx, int fsaFd, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle, streamConsumer_t consume, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif
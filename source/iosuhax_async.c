@@ -0,0 +1,633 @@
+/***************************************************************************
+ * Copyright (C) 2016
+ * by Dimok
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any
+ * damages arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any
+ * purpose, including commercial applications, and to alter it and
+ * redistribute it freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you
+ * must not claim that you wrote the original software. If you use
+ * this software in a product, an acknowledgment in the product
+ * documentation would be appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and
+ * must not be misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source
+ * distribution.
+ ***************************************************************************/
+#include <string.h>
+#include <malloc.h>
+#include "os_functions.h"
+#include "iosuhax.h"
+#include "iosuhax_internal.h"
+
+#define ASYNC_OP_READFILE           0
+#define ASYNC_OP_WRITEFILE          1
+#define ASYNC_OP_RAW_READ           2
+#define ASYNC_OP_RAW_WRITE          3
+
+struct _completionQueue_s
+{
+    uint32_t msg_queue[OS_MESSAGE_QUEUE_SIZE >> 2];
+    OSMessage *messages;
+    uint32_t max_requests;
+    uint32_t in_flight;
+    uint32_t mutex[(OS_MUTEX_SIZE + 3) >> 2];
+};
+
+typedef struct _async_request_t
+{
+    iosuhax_ctx_t *ctx;
+    completionQueue_s *queue;
+    void *userdata;
+    int operation;
+    uint32_t *io_buf;
+    uint32_t io_buf_size;
+    uint32_t *out_buf;
+    uint32_t out_buf_size;
+    void *data;                 // read destination
+    uint32_t data_size;
+    uint32_t elem_size;         // ReadFile results count elements of this size
+} async_request_t;
+
+completionQueue_s *IOSUHAX_CreateCompletionQueue(uint32_t max_requests)
+{
+    if(!max_requests)
+        return NULL;
+
+    completionQueue_s *queue = (completionQueue_s*)malloc(sizeof(completionQueue_s));
+    if(!queue)
+        return NULL;
+
+    queue->messages = (OSMessage*)malloc(sizeof(OSMessage) * max_requests);
+    if(!queue->messages)
+    {
+        free(queue);
+        return NULL;
+    }
+
+    queue->max_requests = max_requests;
+    queue->in_flight = 0;
+
+    OSInitMutex(queue->mutex);
+    OSInitMessageQueue(queue->msg_queue, queue->messages, max_requests);
+    return queue;
+}
+
+void IOSUHAX_DestroyCompletionQueue(completionQueue_s *queue)
+{
+    if(!queue)
+        return;
+
+    //! all requests have to be back before their buffers and the queue can be released
+    completionEntry_s entry;
+    while(IOSUHAX_WaitCompletion(queue, &entry) > 0)
+        ;
+
+    free(queue->messages);
+    free(queue);
+}
+
+static void iosuhax_async_callback(int result, void *context)
+{
+    async_request_t *request = (async_request_t*)context;
+
+    OSMessage message;
+    message.message = request;
+    message.args[0] = (unsigned int)result;
+    message.args[1] = 0;
+    message.args[2] = 0;
+
+    //! can not fail, submitting is limited to the queue size
+    OSSendMessage(request->queue->msg_queue, &message, OS_MESSAGE_NOBLOCK);
+}
+
+//! gives back the queue slot a request reserved
+static void iosuhax_async_unreserve(completionQueue_s *queue)
+{
+    OSLockMutex(queue->mutex);
+    queue->in_flight--;
+    OSUnlockMutex(queue->mutex);
+}
+
+//! A waiter may already block on the queue because of a reserved slot whose request never got
+//! submitted. A message without request is posted in that slot, whoever dequeues it releases it.
+static void iosuhax_async_cancel(completionQueue_s *queue)
+{
+    OSMessage message;
+    message.message = NULL;
+    message.args[0] = 0;
+    message.args[1] = 0;
+    message.args[2] = 0;
+
+    OSSendMessage(queue->msg_queue, &message, OS_MESSAGE_NOBLOCK);
+}
+
+static void iosuhax_async_release(async_request_t *request)
+{
+    iosuhax_pool_t *pool = &request->ctx->pool;
+
+    if(request->out_buf != request->io_buf)
+        iosuhax_pool_free(pool, request->out_buf, request->out_buf_size);
+    iosuhax_pool_free(pool, request->io_buf, request->io_buf_size);
+    free(request);
+}
+
+static int iosuhax_async_finish(completionQueue_s *queue, OSMessage *message, completionEntry_s *entry)
+{
+    async_request_t *request = (async_request_t*)message->message;
+    int res = (int)message->args[0];
+
+    if(res >= 0)
+    {
+        res = request->out_buf[0];
+
+        //! data is put to offset 0x40 to align the buffer output, a short file read only returns res elements
+        if(res >= 0 && request->operation == ASYNC_OP_READFILE)
+        {
+            uint32_t copy_size = (uint32_t)res * request->elem_size;
+            if(copy_size > request->data_size)
+                copy_size = request->data_size;
+            memcpy(request->data, ((uint8_t*)request->out_buf) + 0x40, copy_size);
+        }
+        else if(res >= 0 && request->operation == ASYNC_OP_RAW_READ)
+        {
+            //! raw reads return a status, the whole request was read
+            memcpy(request->data, ((uint8_t*)request->out_buf) + 0x40, request->data_size);
+        }
+    }
+
+    entry->result = res;
+    entry->userdata = request->userdata;
+
+    iosuhax_async_release(request);
+
+    iosuhax_async_unreserve(queue);
+    return 1;
+}
+
+int IOSUHAX_PollCompletion(completionQueue_s *queue, completionEntry_s *entry)
+{
+    OSMessage message;
+
+    while(OSReceiveMessage(queue->msg_queue, &message, OS_MESSAGE_NOBLOCK))
+    {
+        if(message.message)
+            return iosuhax_async_finish(queue, &message, entry);
+
+        //! wake message of a failed submit
+        iosuhax_async_unreserve(queue);
+    }
+
+    return 0;
+}
+
+int IOSUHAX_WaitCompletion(completionQueue_s *queue, completionEntry_s *entry)
+{
+    while(1)
+    {
+        OSLockMutex(queue->mutex);
+        uint32_t in_flight = queue->in_flight;
+        OSUnlockMutex(queue->mutex);
+
+        //! nothing in flight, nothing to wait for
+        if(!in_flight)
+            return 0;
+
+        //! a submit failing after the check above still posts a message, so this can not block forever
+        OSMessage message;
+        OSReceiveMessage(queue->msg_queue, &message, OS_MESSAGE_BLOCK);
+
+        if(message.message)
+            return iosuhax_async_finish(queue, &message, entry);
+
+        iosuhax_async_unreserve(queue);
+    }
+}
+
+static async_request_t *iosuhax_async_alloc(iosuhax_ctx_t *ctx, completionQueue_s *queue, void *userdata, int operation, uint32_t io_buf_size, uint32_t out_buf_size)
+{
+    OSLockMutex(queue->mutex);
+    if(queue->in_flight >= queue->max_requests)
+    {
+        OSUnlockMutex(queue->mutex);
+        return NULL;
+    }
+    queue->in_flight++;
+    OSUnlockMutex(queue->mutex);
+
+    iosuhax_pool_t *pool = &ctx->pool;
+
+    async_request_t *request = (async_request_t*)malloc(sizeof(async_request_t));
+    if(request)
+    {
+        memset(request, 0, sizeof(async_request_t));
+        request->ctx = ctx;
+        request->queue = queue;
+        request->userdata = userdata;
+        request->operation = operation;
+        request->io_buf_size = io_buf_size;
+        request->io_buf = (uint32_t*)iosuhax_pool_alloc(pool, io_buf_size);
+
+        if(out_buf_size)
+        {
+            request->out_buf_size = out_buf_size;
+            request->out_buf = (uint32_t*)iosuhax_pool_alloc(pool, out_buf_size);
+        }
+        else
+        {
+            request->out_buf = request->io_buf;
+        }
+
+        if(request->io_buf && request->out_buf)
+            return request;
+
+        iosuhax_async_release(request);
+    }
+
+    iosuhax_async_cancel(queue);
+    return NULL;
+}
+
+//! async requests get a single buffer each, so they are limited to one transfer chunk
+static int iosuhax_async_size_valid(uint32_t size, uint32_t cnt)
+{
+    return size && cnt <= IOSUHAX_GetTransferChunkSize() / size;
+}
+
+static int iosuhax_async_submit(async_request_t *request, uint32_t ioctl, uint32_t in_size, uint32_t out_size)
+{
+    int res = IOS_IoctlAsync(request->ctx->handle, ioctl, request->io_buf, in_size, request->out_buf, out_size, iosuhax_async_callback, request);
+    if(res < 0)
+    {
+        completionQueue_s *queue = request->queue;
+
+        iosuhax_async_release(request);
+        iosuhax_async_cancel(queue);
+    }
+    return res;
+}
+
+int IOSUHAX_Ctx_FSA_ReadFileAsync(iosuhax_ctx_t *ctx, int fsaFd, void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags, completionQueue_s *queue, void *userdata)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    if(!iosuhax_async_size_valid(size, cnt))
+        return IOS_ERROR_INVALID_SIZE;
+
+    const int input_cnt = 5;
+
+    int out_buf_size = ROUNDUP(size * cnt + 0x40, 0x40);
+
+    async_request_t *request = iosuhax_async_alloc(ctx, queue, userdata, ASYNC_OP_READFILE, sizeof(uint32_t) * input_cnt, out_buf_size);
+    if(!request)
+        return -2;
+
+    request->data = data;
+    request->data_size = size * cnt;
+    request->elem_size = size;
+
+    request->io_buf[0] = fsaFd;
+    request->io_buf[1] = size;
+    request->io_buf[2] = cnt;
+    request->io_buf[3] = fileHandle;
+    request->io_buf[4] = flags;
+
+    return iosuhax_async_submit(request, IOCTL_FSA_READFILE, sizeof(uint32_t) * input_cnt, out_buf_size);
+}
+
+int IOSUHAX_Ctx_FSA_WriteFileAsync(iosuhax_ctx_t *ctx, int fsaFd, const void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags, completionQueue_s *queue, void *userdata)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    if(!iosuhax_async_size_valid(size, cnt))
+        return IOS_ERROR_INVALID_SIZE;
+
+    int io_buf_size = ROUNDUP(size * cnt + 0x40, 0x40);
+
+    async_request_t *request = iosuhax_async_alloc(ctx, queue, userdata, ASYNC_OP_WRITEFILE, io_buf_size, 0x40);
+    if(!request)
+        return -2;
+
+    request->io_buf[0] = fsaFd;
+    request->io_buf[1] = size;
+    request->io_buf[2] = cnt;
+    request->io_buf[3] = fileHandle;
+    request->io_buf[4] = flags;
+
+    //! data is put to offset 0x40 to align the buffer input
+    memcpy(((uint8_t*)request->io_buf) + 0x40, data, size * cnt);
+
+    return iosuhax_async_submit(request, IOCTL_FSA_WRITEFILE, io_buf_size, sizeof(int));
+}
+
+int IOSUHAX_Ctx_FSA_RawReadAsync(iosuhax_ctx_t *ctx, int fsaFd, void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle, completionQueue_s *queue, void *userdata)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    if(!iosuhax_async_size_valid(block_size, block_cnt))
+        return IOS_ERROR_INVALID_SIZE;
+
+    const int input_cnt = 6;
+
+    int out_buf_size = ROUNDUP(block_size * block_cnt + 0x40, 0x40);
+
+    async_request_t *request = iosuhax_async_alloc(ctx, queue, userdata, ASYNC_OP_RAW_READ, sizeof(uint32_t) * input_cnt, out_buf_size);
+    if(!request)
+        return -2;
+
+    request->data = data;
+    request->data_size = block_size * block_cnt;
+
+    request->io_buf[0] = fsaFd;
+    request->io_buf[1] = block_size;
+    request->io_buf[2] = block_cnt;
+    request->io_buf[3] = (sector_offset >> 32) & 0xFFFFFFFF;
+    request->io_buf[4] = sector_offset & 0xFFFFFFFF;
+    request->io_buf[5] = device_handle;
+
+    return iosuhax_async_submit(request, IOCTL_FSA_RAW_READ, sizeof(uint32_t) * input_cnt, out_buf_size);
+}
+
+int IOSUHAX_Ctx_FSA_RawWriteAsync(iosuhax_ctx_t *ctx, int fsaFd, const void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle, completionQueue_s *queue, void *userdata)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    if(!iosuhax_async_size_valid(block_size, block_cnt))
+        return IOS_ERROR_INVALID_SIZE;
+
+    int io_buf_size = ROUNDUP(block_size * block_cnt + 0x40, 0x40);
+
+    async_request_t *request = iosuhax_async_alloc(ctx, queue, userdata, ASYNC_OP_RAW_WRITE, io_buf_size, 0);
+    if(!request)
+        return -2;
+
+    request->io_buf[0] = fsaFd;
+    request->io_buf[1] = block_size;
+    request->io_buf[2] = block_cnt;
+    request->io_buf[3] = (sector_offset >> 32) & 0xFFFFFFFF;
+    request->io_buf[4] = sector_offset & 0xFFFFFFFF;
+    request->io_buf[5] = device_handle;
+
+    //! data is put to offset 0x40 to align the buffer input
+    memcpy(((uint8_t*)request->io_buf) + 0x40, data, block_size * block_cnt);
+
+    return iosuhax_async_submit(request, IOCTL_FSA_RAW_WRITE, io_buf_size, 4);
+}
+
+typedef struct _stream_slot_t
+{
+    void *msg_queue;
+    uint32_t index;
+} stream_slot_t;
+
+static void iosuhax_stream_callback(int result, void *context)
+{
+    stream_slot_t *slot = (stream_slot_t*)context;
+
+    OSMessage message;
+    message.message = slot;
+    message.args[0] = (unsigned int)result;
+    message.args[1] = 0;
+    message.args[2] = 0;
+
+    OSSendMessage(slot->msg_queue, &message, OS_MESSAGE_NOBLOCK);
+}
+
+//! Double buffered read engine. While the consumer works on one chunk the read of the next one
+//! is already queued in IOSU. is_raw selects raw sector reads, else file reads with element size 1.
+static int iosuhax_stream_read(iosuhax_ctx_t *ctx, int fsaFd, int handle, uint32_t flags, uint32_t block_size, uint64_t sector_offset, uint32_t total,
+                               int is_raw, streamConsumer_t consume, void *userdata)
+{
+    if(ctx->handle < 0)
+        return ctx->handle;
+
+    iosuhax_pool_t *pool = &ctx->pool;
+
+    uint32_t chunk_size = IOSUHAX_GetTransferChunkSize();
+    if(is_raw)
+    {
+        chunk_size -= chunk_size % block_size;
+        if(chunk_size == 0)
+            chunk_size = block_size;
+    }
+    if(chunk_size > total)
+        chunk_size = total;
+
+    uint32_t out_buf_size = ROUNDUP(chunk_size + 0x40, 0x40);
+
+    ALIGN(0x20) uint32_t io_buf[2][0x20 >> 2];
+    uint32_t *out_buf[2];
+    stream_slot_t slots[2];
+    uint32_t msg_queue[OS_MESSAGE_QUEUE_SIZE >> 2];
+    OSMessage messages[2];
+
+    OSInitMessageQueue(msg_queue, messages, 2);
+
+    out_buf[0] = (uint32_t*)iosuhax_pool_alloc(pool, out_buf_size);
+    out_buf[1] = (uint32_t*)iosuhax_pool_alloc(pool, out_buf_size);
+    if(!out_buf[0] || !out_buf[1])
+    {
+        iosuhax_pool_free(pool, out_buf[0], out_buf_size);
+        iosuhax_pool_free(pool, out_buf[1], out_buf_size);
+        return -2;
+    }
+
+    uint32_t submitted = 0;     // bytes requested so far
+    uint32_t requested[2] = { 0, 0 };
+    int results[2] = { 0, 0 };
+    int completed[2] = { 0, 0 };
+    //! file reads advance the file position in the order IOSU runs them, so only one may be queued
+    int max_in_flight = is_raw ? 2 : 1;
+    int in_flight = 0;
+    int held = 0;               // buffers queued or completed and not yet consumed
+    int stopped = 0;
+    int done = 0;
+    int res = 0;
+    int submit_res = 0;
+    int cur = 0;
+
+    while(1)
+    {
+        //! queue reads into the free buffers
+        while(held < 2 && in_flight < max_in_flight && submitted < total && !stopped)
+        {
+            int idx = (cur + held) & 1;
+            uint32_t size = total - submitted;
+            if(size > chunk_size)
+                size = chunk_size;
+
+            slots[idx].msg_queue = msg_queue;
+            slots[idx].index = idx;
+
+            int ret;
+            if(is_raw)
+            {
+                uint64_t sector = sector_offset + submitted / block_size;
+                io_buf[idx][0] = fsaFd;
+                io_buf[idx][1] = block_size;
+                io_buf[idx][2] = size / block_size;
+                io_buf[idx][3] = (sector >> 32) & 0xFFFFFFFF;
+                io_buf[idx][4] = sector & 0xFFFFFFFF;
+                io_buf[idx][5] = handle;
+                ret = IOS_IoctlAsync(ctx->handle, IOCTL_FSA_RAW_READ, io_buf[idx], sizeof(uint32_t) * 6, out_buf[idx], size + 0x40, iosuhax_stream_callback, &slots[idx]);
+            }
+            else
+            {
+                io_buf[idx][0] = fsaFd;
+                io_buf[idx][1] = 1;
+                io_buf[idx][2] = size;
+                io_buf[idx][3] = handle;
+                io_buf[idx][4] = flags;
+                ret = IOS_IoctlAsync(ctx->handle, IOCTL_FSA_READFILE, io_buf[idx], sizeof(uint32_t) * 5, out_buf[idx], ROUNDUP(size + 0x40, 0x40), iosuhax_stream_callback, &slots[idx]);
+            }
+
+            if(ret < 0)
+            {
+                //! reported once the reads already queued are consumed
+                submit_res = ret;
+                submitted = total;
+                break;
+            }
+
+            requested[idx] = size;
+            submitted += size;
+            held++;
+            in_flight++;
+        }
+
+        if(!held)
+            break;
+
+        //! completions may arrive in any order, the slot tells which buffer is done
+        if(!completed[cur])
+        {
+            OSMessage message;
+            OSReceiveMessage(msg_queue, &message, OS_MESSAGE_BLOCK);
+
+            stream_slot_t *slot = (stream_slot_t*)message.message;
+            results[slot->index] = (int)message.args[0];
+            completed[slot->index] = 1;
+            in_flight--;
+            //! queue the next read before consuming this one
+            continue;
+        }
+
+        completed[cur] = 0;
+        held--;
+
+        int ret = results[cur];
+        if(ret >= 0)
+            ret = out_buf[cur][0];
+
+        //! raw reads return a status instead of a byte count, ReadFile returns 0 at end of file
+        int failed = is_raw ? (ret < 0) : (ret <= 0);
+
+        if(stopped || failed)
+        {
+            if(!stopped && ret < 0)
+                res = ret;
+            //! drop whatever is still queued
+            stopped = 1;
+            cur ^= 1;
+            continue;
+        }
+
+        uint32_t got = is_raw ? requested[cur] : (uint32_t)ret;
+
+        if(!is_raw && got < requested[cur])
+            stopped = 1;
+
+        //! data is put to offset 0x40 to align the buffer output
+        int cb_res = consume(userdata, ((uint8_t*)out_buf[cur]) + 0x40, got);
+        done += got;
+
+        if(cb_res < 0)
+        {
+            res = cb_res;
+            stopped = 1;
+        }
+
+        cur ^= 1;
+    }
+
+    iosuhax_pool_free(pool, out_buf[0], out_buf_size);
+    iosuhax_pool_free(pool, out_buf[1], out_buf_size);
+
+    if(res >= 0 && submit_res < 0)
+        res = submit_res;
+
+    if(res < 0 && done == 0)
+        return res;
+
+    return done;
+}
+
+int IOSUHAX_Ctx_FSA_ReadFileStream(iosuhax_ctx_t *ctx, int fsaFd, int fileHandle, uint32_t size, uint32_t flags, streamConsumer_t consume, void *userdata)
+{
+    if(!consume)
+        return IOS_ERROR_INVALID_ARG;
+
+    if(!size)
+        return 0;
+
+    return iosuhax_stream_read(ctx, fsaFd, fileHandle, flags, 1, 0, size, 0, consume, userdata);
+}
+
+int IOSUHAX_Ctx_FSA_RawReadStream(iosuhax_ctx_t *ctx, int fsaFd, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle, streamConsumer_t consume, void *userdata)
+{
+    if(!consume || !block_size)
+        return IOS_ERROR_INVALID_ARG;
+
+    if(!block_cnt)
+        return 0;
+
+    //! the stream length is kept in bytes
+    if(block_cnt > 0xFFFFFFFF / block_size)
+        return IOS_ERROR_INVALID_ARG;
+
+    return iosuhax_stream_read(ctx, fsaFd, device_handle, 0, block_size, sector_offset, block_size * block_cnt, 1, consume, userdata);
+}
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! default context
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+int IOSUHAX_FSA_ReadFileAsync(int fsaFd, void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags, completionQueue_s *queue, void *userdata)
+{
+    return IOSUHAX_Ctx_FSA_ReadFileAsync(IOSUHAX_GetDefaultCtx(), fsaFd, data, size, cnt, fileHandle, flags, queue, userdata);
+}
+
+int IOSUHAX_FSA_WriteFileAsync(int fsaFd, const void* data, uint32_t size, uint32_t cnt, int fileHandle, uint32_t flags, completionQueue_s *queue, void *userdata)
+{
+    return IOSUHAX_Ctx_FSA_WriteFileAsync(IOSUHAX_GetDefaultCtx(), fsaFd, data, size, cnt, fileHandle, flags, queue, userdata);
+}
+
+int IOSUHAX_FSA_RawReadAsync(int fsaFd, void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle, completionQueue_s *queue, void *userdata)
+{
+    return IOSUHAX_Ctx_FSA_RawReadAsync(IOSUHAX_GetDefaultCtx(), fsaFd, data, block_size, block_cnt, sector_offset, device_handle, queue, userdata);
+}
+
+int IOSUHAX_FSA_RawWriteAsync(int fsaFd, const void* data, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle, completionQueue_s *queue, void *userdata)
+{
+    return IOSUHAX_Ctx_FSA_RawWriteAsync(IOSUHAX_GetDefaultCtx(), fsaFd, data, block_size, block_cnt, sector_offset, device_handle, queue, userdata);
+}
+
+int IOSUHAX_FSA_ReadFileStream(int fsaFd, int fileHandle, uint32_t size, uint32_t flags, streamConsumer_t consume, void *userdata)
+{
+    return IOSUHAX_Ctx_FSA_ReadFileStream(IOSUHAX_GetDefaultCtx(), fsaFd, fileHandle, size, flags, consume, userdata);
+}
+
+int IOSUHAX_FSA_RawReadStream(int fsaFd, uint32_t block_size, uint32_t block_cnt, uint64_t sector_offset, int device_handle, streamConsumer_t consume, void *userdata)
+{
+    return IOSUHAX_Ctx_FSA_RawReadStream(IOSUHAX_GetDefaultCtx(), fsaFd, block_size, block_cnt, sector_offset, device_handle, consume, userdata);
+}
@@ -0,0 +1,455 @@
+/***************************************************************************
+ * Copyright (C) 2016
+ * by Dimok
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any
+ * damages arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any
+ * purpose, including commercial applications, and to alter it and
+ * redistribute it freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you
+ * must not claim that you wrote the original software. If you use
+ * this software in a product, an acknowledgment in the product
+ * documentation would be appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and
+ * must not be misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source
+ * distribution.
+ ***************************************************************************/
+#include <string.h>
+#include <malloc.h>
+#include "os_functions.h"
+#include "iosuhax.h"
+#include "iosuhax_copy.h"
+#include "iosuhax_internal.h"
+
+#define COPY_CHUNK_SIZE             0x40000
+#define COPY_BUFFER_COUNT           4
+#define COPY_MAX_BUFFERS            32
+#define COPY_STACK_SIZE             0x8000
+#define COPY_MAX_PATH               0x280
+#define COPY_DIR_BATCH              8
+#define COPY_DIR_MODE               0777
+
+typedef struct _copy_session_t
+{
+    ALIGN(0x20) uint32_t reader_thread[OS_THREAD_SIZE >> 2];
+    ALIGN(0x20) uint32_t writer_thread[OS_THREAD_SIZE >> 2];
+    uint32_t free_queue[OS_MESSAGE_QUEUE_SIZE >> 2];    // empty buffers for the reader
+    uint32_t full_queue[OS_MESSAGE_QUEUE_SIZE >> 2];    // filled buffers for the writer
+    OSMessage free_msgs[COPY_MAX_BUFFERS];
+    OSMessage full_msgs[COPY_MAX_BUFFERS + 1];
+    iosuhax_copy_options_t options;
+    iosuhax_ctx_t *ctx;
+    int srcFsaFd;
+    int dstFsaFd;
+    uint8_t *buffers;
+    uint8_t *reader_stack;
+    uint8_t *writer_stack;
+
+    // current file
+    const char *src_path;
+    int srcHandle;
+    int dstHandle;
+    uint32_t size;
+    volatile int abort;
+    int read_result;
+    int write_result;
+} copy_session_t;
+
+void iosuhax_copy_default_options(iosuhax_copy_options_t *options)
+{
+    memset(options, 0, sizeof(iosuhax_copy_options_t));
+    options->chunk_size = COPY_CHUNK_SIZE;
+    options->buffer_count = COPY_BUFFER_COUNT;
+    options->reader_core = 0;
+    options->writer_core = 2;
+    options->thread_priority = 16;
+}
+
+//! reads a single byte at the current source position
+static int copy_source_has_more(copy_session_t *session, void *buffer)
+{
+    return IOSUHAX_Ctx_FSA_ReadFile(session->ctx, session->srcFsaFd, buffer, 0x01, 0x01, session->srcHandle, 0) > 0;
+}
+
+//! The terminating message has no buffer and carries the read result.
+static int copy_reader_thread(int argc, const char **argv)
+{
+    copy_session_t *session = (copy_session_t*)argv;
+    uint32_t done = 0;
+    int result = 0;
+    OSMessage message;
+
+    while(done < session->size && !session->abort)
+    {
+        OSReceiveMessage(session->free_queue, &message, OS_MESSAGE_BLOCK);
+
+        // the writer may have given up while this thread waited for a buffer
+        if(session->abort)
+        {
+            OSSendMessage(session->free_queue, &message, OS_MESSAGE_NOBLOCK);
+            break;
+        }
+
+        uint32_t chunk = session->size - done;
+        if(chunk > session->options.chunk_size)
+            chunk = session->options.chunk_size;
+
+        result = IOSUHAX_Ctx_FSA_ReadFile(session->ctx, session->srcFsaFd, message.message, 0x01, chunk, session->srcHandle, 0);
+        if(result <= 0)
+        {
+            // the file ended before its stat size
+            if(result == 0)
+                result = FSA_STATUS_END_OF_FILE;
+            OSSendMessage(session->free_queue, &message, OS_MESSAGE_NOBLOCK);
+            break;
+        }
+
+        message.args[0] = result;
+        OSSendMessage(session->full_queue, &message, OS_MESSAGE_BLOCK);
+        done += result;
+        result = 0;
+    }
+
+    // the stat size is 32 bit, data past it means the file does not fit
+    if(result == 0 && done == session->size && !session->abort)
+    {
+        OSReceiveMessage(session->free_queue, &message, OS_MESSAGE_BLOCK);
+        if(copy_source_has_more(session, message.message))
+            result = IOSUHAX_COPY_FILE_TOO_LARGE;
+        OSSendMessage(session->free_queue, &message, OS_MESSAGE_NOBLOCK);
+    }
+
+    message.message = NULL;
+    message.args[0] = result;
+    OSSendMessage(session->full_queue, &message, OS_MESSAGE_BLOCK);
+
+    session->read_result = result;
+    return 0;
+}
+
+//! After an error the writer keeps draining the ring, so the reader never blocks on a full queue.
+static int copy_writer_thread(int argc, const char **argv)
+{
+    copy_session_t *session = (copy_session_t*)argv;
+    uint32_t done = 0;
+    int result = 0;
+    OSMessage message;
+
+    while(1)
+    {
+        OSReceiveMessage(session->full_queue, &message, OS_MESSAGE_BLOCK);
+        if(!message.message)
+            break;
+
+        if(result == 0)
+        {
+            uint32_t size = message.args[0];
+
+            int res = IOSUHAX_Ctx_FSA_WriteFile(session->ctx, session->dstFsaFd, message.message, 0x01, size, session->dstHandle, 0);
+            if(res < 0 || (uint32_t)res != size)
+            {
+                result = (res < 0) ? res : FSA_STATUS_STORAGE_FULL;
+                session->abort = 1;
+            }
+            else
+            {
+                done += size;
+
+                if(session->options.progress && session->options.progress(session->options.userdata, session->src_path, done, session->size))
+                {
+                    result = IOSUHAX_COPY_CANCELLED;
+                    session->abort = 1;
+                }
+            }
+        }
+
+        OSSendMessage(session->free_queue, &message, OS_MESSAGE_BLOCK);
+    }
+
+    session->write_result = result;
+    return 0;
+}
+
+static int copy_start_thread(copy_session_t *session, void *thread, OSThreadEntry entry, uint8_t *stack, int core)
+{
+    uint32_t attr = (core >= 0 && core <= 2) ? (OS_THREAD_ATTRIB_AFFINITY_CPU0 << core) : OS_THREAD_ATTRIB_AFFINITY_ANY;
+
+    if(!OSCreateThread(thread, entry, 0, session, stack + COPY_STACK_SIZE, COPY_STACK_SIZE, session->options.thread_priority, attr))
+        return -1;
+
+    OSResumeThread(thread);
+    return 0;
+}
+
+static int copy_file_in_session(copy_session_t *session, const char *src_path, const char *dst_path)
+{
+    int result = IOSUHAX_Ctx_FSA_OpenFile(session->ctx, session->srcFsaFd, src_path, "r", &session->srcHandle);
+    if(result < 0)
+        return result;
+
+    fileStat_s stats;
+    result = IOSUHAX_Ctx_FSA_StatFile(session->ctx, session->srcFsaFd, session->srcHandle, &stats);
+    if(result < 0)
+    {
+        IOSUHAX_Ctx_FSA_CloseFile(session->ctx, session->srcFsaFd, session->srcHandle);
+        return result;
+    }
+
+    result = IOSUHAX_Ctx_FSA_OpenFile(session->ctx, session->dstFsaFd, dst_path, "w", &session->dstHandle);
+    if(result < 0)
+    {
+        IOSUHAX_Ctx_FSA_CloseFile(session->ctx, session->srcFsaFd, session->srcHandle);
+        return result;
+    }
+
+    session->src_path = src_path;
+    session->size = stats.size;
+    session->abort = 0;
+    session->read_result = 0;
+    session->write_result = 0;
+
+    // every buffer starts out empty
+    uint32_t i;
+    OSInitMessageQueue(session->free_queue, session->free_msgs, session->options.buffer_count);
+    OSInitMessageQueue(session->full_queue, session->full_msgs, session->options.buffer_count + 1);
+
+    for(i = 0; i < session->options.buffer_count; i++)
+    {
+        OSMessage message;
+        memset(&message, 0, sizeof(message));
+        message.message = session->buffers + i * session->options.chunk_size;
+        OSSendMessage(session->free_queue, &message, OS_MESSAGE_NOBLOCK);
+    }
+
+    if(session->size == 0)
+    {
+        if(copy_source_has_more(session, session->buffers))
+            result = IOSUHAX_COPY_FILE_TOO_LARGE;
+        else if(session->options.progress && session->options.progress(session->options.userdata, src_path, 0, 0))
+            result = IOSUHAX_COPY_CANCELLED;
+    }
+    else if(copy_start_thread(session, session->writer_thread, copy_writer_thread, session->writer_stack, session->options.writer_core) < 0)
+    {
+        result = IOSUHAX_COPY_THREAD_ERROR;
+    }
+    else
+    {
+        int thread_result;
+
+        if(copy_start_thread(session, session->reader_thread, copy_reader_thread, session->reader_stack, session->options.reader_core) < 0)
+        {
+            // let the writer run dry
+            OSMessage message;
+            memset(&message, 0, sizeof(message));
+            OSSendMessage(session->full_queue, &message, OS_MESSAGE_BLOCK);
+            session->read_result = IOSUHAX_COPY_THREAD_ERROR;
+        }
+        else
+        {
+            OSJoinThread(session->reader_thread, &thread_result);
+        }
+
+        OSJoinThread(session->writer_thread, &thread_result);
+
+        result = (session->write_result < 0) ? session->write_result : session->read_result;
+    }
+
+    IOSUHAX_Ctx_FSA_CloseFile(session->ctx, session->srcFsaFd, session->srcHandle);
+
+    int close_result = IOSUHAX_Ctx_FSA_CloseFile(session->ctx, session->dstFsaFd, session->dstHandle);
+    if(result == 0 && close_result < 0)
+        result = close_result;
+
+    // do not leave a truncated file behind that looks like a finished copy
+    if(result < 0)
+        IOSUHAX_Ctx_FSA_Remove(session->ctx, session->dstFsaFd, dst_path);
+
+    return result;
+}
+
+//! src and dst are COPY_MAX_PATH buffers, entry names are appended in place and removed again
+static int copy_tree_in_session(copy_session_t *session, char *src, char *dst)
+{
+    int result = IOSUHAX_Ctx_FSA_MakeDir(session->ctx, session->dstFsaFd, dst, COPY_DIR_MODE);
+    if(result < 0 && result != FSA_STATUS_ALREADY_EXISTS)
+        return result;
+
+    int dirHandle;
+    result = IOSUHAX_Ctx_FSA_OpenDir(session->ctx, session->srcFsaFd, src, &dirHandle);
+    if(result < 0)
+        return result;
+
+    directoryEntry_s *entries = (directoryEntry_s*)malloc(COPY_DIR_BATCH * sizeof(directoryEntry_s));
+    if(!entries)
+    {
+        IOSUHAX_Ctx_FSA_CloseDir(session->ctx, session->srcFsaFd, dirHandle);
+        return IOSUHAX_COPY_NO_MEMORY;
+    }
+
+    uint32_t src_len = strlen(src);
+    uint32_t dst_len = strlen(dst);
+
+    while(1)
+    {
+        int cnt = IOSUHAX_Ctx_FSA_ReadDirMulti(session->ctx, session->srcFsaFd, dirHandle, entries, COPY_DIR_BATCH);
+        if(cnt < 0)
+        {
+            result = (cnt == FSA_STATUS_END_OF_DIR) ? 0 : cnt;
+            break;
+        }
+
+        int i;
+        for(i = 0; i < cnt && result >= 0; i++)
+        {
+            const char *name = entries[i].name;
+            if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+                continue;
+
+            uint32_t name_len = strlen(name);
+            if(src_len + name_len + 2 > COPY_MAX_PATH || dst_len + name_len + 2 > COPY_MAX_PATH)
+            {
+                result = IOSUHAX_COPY_PATH_TOO_LONG;
+                break;
+            }
+
+            src[src_len] = '/';
+            strcpy(src + src_len + 1, name);
+            dst[dst_len] = '/';
+            strcpy(dst + dst_len + 1, name);
+
+            if(entries[i].stat.flag & 0x80000000)
+                result = copy_tree_in_session(session, src, dst);
+            else
+                result = copy_file_in_session(session, src, dst);
+
+            src[src_len] = 0;
+            dst[dst_len] = 0;
+        }
+
+        if(result < 0)
+            break;
+    }
+
+    free(entries);
+    IOSUHAX_Ctx_FSA_CloseDir(session->ctx, session->srcFsaFd, dirHandle);
+    return result;
+}
+
+static void copy_session_destroy(copy_session_t *session)
+{
+    if(session->srcFsaFd >= 0)
+        IOSUHAX_Ctx_FSA_Close(session->ctx, session->srcFsaFd);
+    if(session->dstFsaFd >= 0)
+        IOSUHAX_Ctx_FSA_Close(session->ctx, session->dstFsaFd);
+
+    free(session->buffers);
+    free(session->reader_stack);
+    free(session->writer_stack);
+    free(session);
+}
+
+static copy_session_t *copy_session_create(const iosuhax_copy_options_t *options, int *result)
+{
+    copy_session_t *session = (copy_session_t*)memalign(0x20, sizeof(copy_session_t));
+    if(!session)
+    {
+        *result = IOSUHAX_COPY_NO_MEMORY;
+        return NULL;
+    }
+
+    memset(session, 0, sizeof(copy_session_t));
+    session->srcFsaFd = -1;
+    session->dstFsaFd = -1;
+
+    if(options)
+        memcpy(&session->options, options, sizeof(iosuhax_copy_options_t));
+    else
+        iosuhax_copy_default_options(&session->options);
+
+    session->ctx = session->options.ctx ? session->options.ctx : IOSUHAX_GetDefaultCtx();
+
+    // buffers stay cache aligned so large reads can go to them directly
+    session->options.chunk_size = ROUNDUP(session->options.chunk_size ? session->options.chunk_size : COPY_CHUNK_SIZE, 0x40);
+    if(session->options.buffer_count < 2)
+        session->options.buffer_count = 2;
+    if(session->options.buffer_count > COPY_MAX_BUFFERS)
+        session->options.buffer_count = COPY_MAX_BUFFERS;
+
+    session->buffers = (uint8_t*)memalign(0x40, session->options.buffer_count * session->options.chunk_size);
+    session->reader_stack = (uint8_t*)memalign(0x20, COPY_STACK_SIZE);
+    session->writer_stack = (uint8_t*)memalign(0x20, COPY_STACK_SIZE);
+    if(!session->buffers || !session->reader_stack || !session->writer_stack)
+    {
+        copy_session_destroy(session);
+        *result = IOSUHAX_COPY_NO_MEMORY;
+        return NULL;
+    }
+
+    session->srcFsaFd = IOSUHAX_Ctx_FSA_Open(session->ctx);
+    session->dstFsaFd = IOSUHAX_Ctx_FSA_Open(session->ctx);
+    if(session->srcFsaFd < 0 || session->dstFsaFd < 0)
+    {
+        *result = (session->srcFsaFd < 0) ? session->srcFsaFd : session->dstFsaFd;
+        copy_session_destroy(session);
+        return NULL;
+    }
+
+    *result = 0;
+    return session;
+}
+
+int iosuhax_copy_file(const char *src_path, const char *dst_path, const iosuhax_copy_options_t *options)
+{
+    int result;
+    copy_session_t *session = copy_session_create(options, &result);
+    if(!session)
+        return result;
+
+    result = copy_file_in_session(session, src_path, dst_path);
+
+    copy_session_destroy(session);
+    return result;
+}
+
+int iosuhax_copy_tree(const char *src_dir, const char *dst_dir, const iosuhax_copy_options_t *options)
+{
+    if(strlen(src_dir) >= COPY_MAX_PATH || strlen(dst_dir) >= COPY_MAX_PATH)
+        return IOSUHAX_COPY_PATH_TOO_LONG;
+
+    int result;
+    copy_session_t *session = copy_session_create(options, &result);
+    if(!session)
+        return result;
+
+    char *src = (char*)malloc(COPY_MAX_PATH * 2);
+    if(!src)
+    {
+        copy_session_destroy(session);
+        return IOSUHAX_COPY_NO_MEMORY;
+    }
+
+    char *dst = src + COPY_MAX_PATH;
+    strcpy(src, src_dir);
+    strcpy(dst, dst_dir);
+
+    // entries get appended with a separator of their own
+    uint32_t len = strlen(src);
+    if(len > 1 && src[len - 1] == '/')
+        src[len - 1] = 0;
+    len = strlen(dst);
+    if(len > 1 && dst[len - 1] == '/')
+        dst[len - 1] = 0;
+
+    result = copy_tree_in_session(session, src, dst);
+
+    free(src);
+    copy_session_destroy(session);
+    return result;
+}
@@ -0,0 +1,74 @@
+/***************************************************************************
+ * Copyright (C) 2016
+ * by Dimok
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any
+ * damages arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any
+ * purpose, including commercial applications, and to alter it and
+ * redistribute it freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you
+ * must not claim that you wrote the original software. If you use
+ * this software in a product, an acknowledgment in the product
+ * documentation would be appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and
+ * must not be misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source
+ * distribution.
+ ***************************************************************************/
+#ifndef _IOSUHAX_COPY_H_
+#define _IOSUHAX_COPY_H_
+
+#include <stdint.h>
+#include "iosuhax.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! copy errors sit well below the IOS and FSA status codes so they can not be mistaken for them
+#define IOSUHAX_COPY_ERROR_BASE         -0x100000
+#define IOSUHAX_COPY_CANCELLED          (IOSUHAX_COPY_ERROR_BASE - 1)
+#define IOSUHAX_COPY_PATH_TOO_LONG      (IOSUHAX_COPY_ERROR_BASE - 2)
+#define IOSUHAX_COPY_NO_MEMORY          (IOSUHAX_COPY_ERROR_BASE - 3)
+#define IOSUHAX_COPY_THREAD_ERROR       (IOSUHAX_COPY_ERROR_BASE - 4)
+#define IOSUHAX_COPY_FILE_TOO_LARGE     (IOSUHAX_COPY_ERROR_BASE - 5)
+
+//! called from the writer thread after every chunk, return non-zero to cancel the copy
+typedef int (*iosuhax_copy_progress_t)(void *userdata, const char *src_path, uint32_t done, uint32_t size);
+
+typedef struct _iosuhax_copy_options_t
+{
+    iosuhax_ctx_t *ctx;                 //! context used for all requests, NULL for the default context
+    uint32_t chunk_size;                //! bytes per read and write (default 256 KiB)
+    uint32_t buffer_count;              //! chunks in flight between reader and writer (default 4, 2 to 32)
+    int reader_core;                    //! core of the reader thread (default 0)
+    int writer_core;                    //! core of the writer thread (default 2)
+    int thread_priority;                //! priority of both threads (default 16)
+    iosuhax_copy_progress_t progress;   //! optional
+    void *userdata;
+} iosuhax_copy_options_t;
+
+void iosuhax_copy_default_options(iosuhax_copy_options_t *options);
+
+//! Paths are FSA paths, e.g. /vol/storage_sdcard/file. A reader and a writer thread pass chunks
+//! through a ring of buffers so both devices are busy at the same time. Source and destination
+//! use their own FSA client handles. options may be NULL for the defaults.
+//! FSA file sizes are 32 bit, a source that still has data past 4 GiB fails with IOSUHAX_COPY_FILE_TOO_LARGE.
+//! A destination file that was not copied completely, including a cancelled one, is removed again.
+//! Returns 0, a negative IOS or FSA error or one of the IOSUHAX_COPY_ errors.
+int iosuhax_copy_file(const char *src_path, const char *dst_path, const iosuhax_copy_options_t *options);
+//! copies the content of src_dir into dst_dir, creating dst_dir and missing sub directories.
+//! Stops at the first error, files copied and directories created up to then are kept.
+int iosuhax_copy_tree(const char *src_dir, const char *dst_dir, const iosuhax_copy_options_t *options);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -33,16 +33,71 @@
 #include <sys/iosupport.h>
 #include "os_functions.h"
 #include "iosuhax.h"
+#include "iosuhax_devoptab.h"
+#include "iosuhax_internal.h"
+
+#define FS_DEV_READ_AHEAD_MIN       0x1000
+#define FS_DEV_MAX_FSA_HANDLES      8
+#define FS_DEV_REGISTRY_BUCKETS     16
+#define FS_DEV_STAT_PATH_MAX        0x100
+//! directory entries fetched per refill, each one is still a READDIR round-trip to the resident
+#define FS_DEV_DIR_BATCH            8
+
+//! reader/writer lock, namespace changes are exclusive while lookups run shared
+typedef struct _fs_dev_rwlock_t {
+    uint32_t mutex[(OS_MUTEX_SIZE + 3) >> 2];
+    uint32_t cond[(OS_COND_SIZE + 3) >> 2];
+    int readers;
+    int writer;
+} fs_dev_rwlock_t;
+
+typedef struct _fs_dev_stat_entry_t {
+    struct _fs_dev_stat_entry_t *hash_next;
+    struct _fs_dev_stat_entry_t *lru_prev;
+    struct _fs_dev_stat_entry_t *lru_next;
+    int in_use;
+    uint32_t hash;
+    int result;                                 /* GetStat result, "not found" is cached as well */
+    long long time;
+    fileStat_s stats;
+    char path[FS_DEV_STAT_PATH_MAX];            /* Path relative to the mount path */
+} fs_dev_stat_entry_t;
+
+typedef struct _fs_dev_stat_cache_t {
+    fs_dev_stat_entry_t *entries;
+    fs_dev_stat_entry_t **buckets;
+    uint32_t bucket_mask;
+    fs_dev_stat_entry_t *lru_head;              /* Most recently used */
+    fs_dev_stat_entry_t *lru_tail;
+    long long ttl;                              /* In OSGetTime ticks, 0 never expires */
+    uint32_t generation;                        /* Bumped by every invalidation */
+    uint32_t mutex[(OS_MUTEX_SIZE + 3) >> 2];
+} fs_dev_stat_cache_t;
 
 typedef struct _fs_dev_private_t {
     char *mount_path;
-    int fsaFd;
+    int fsaFd;                                  /* Handle passed to mount_fs, used for mount/unmount */
+    int fsaFds[FS_DEV_MAX_FSA_HANDLES];         /* Handles used for file and directory operations, [0] is fsaFd */
+    uint32_t fsaCount;
+    uint32_t fsaNext;
     int mounted;
-    void *pMutex;
+    uint32_t file_cache_size;
+    int read_only;
+    fs_dev_rwlock_t lock;
+    fs_dev_stat_cache_t stat_cache;
+    const char *name;                           /* Device name without the colon */
+    uint32_t name_len;
+    uint32_t name_hash;
+    devoptab_t *devoptab;
+    struct _fs_dev_private_t *next;             /* Next device in the same registry bucket */
 } fs_dev_private_t;
 
+//! mounted devices hashed by name, so path lookups do not have to scan the devoptab table
+static fs_dev_private_t *fs_dev_registry[FS_DEV_REGISTRY_BUCKETS];
+
 typedef struct _fs_dev_file_state_t {
     fs_dev_private_t *dev;
+    int fsaFd;                                  /* FSA client handle the file was opened on */
     int fd;                                     /* File descriptor */
     int flags;                                  /* Opening flags */
     int read;                                   /* True if allowed to read from file */
@@ -50,61 +105,675 @@ typedef struct _fs_dev_file_state_t {
     int append;                                 /* True if allowed to append to file */
     uint32_t pos;                                    /* Current position within the file (in bytes) */
     uint32_t len;                                    /* Total length of the file (in bytes) */
+    uint32_t dev_pos;                                /* Position of the FSA file handle */
+    char *cache;                                /* Read-ahead/write-back buffer, NULL if uncached */
+    uint32_t cache_size;                             /* Size of the cache buffer */
+    uint32_t cache_pos;                              /* File offset of the cached data */
+    uint32_t cache_len;                              /* Valid bytes in the cache */
+    uint32_t dirty_start;                            /* Dirty range within the cache, empty if start == end */
+    uint32_t dirty_end;
+    uint32_t ra_size;                                /* Current read-ahead window */
+    uint32_t ra_next;                                /* File offset a sequential read continues at */
+    uint32_t mutex[(OS_MUTEX_SIZE + 3) >> 2];        /* Serializes operations on this file */
+    uint32_t path_hash;                              /* Stat cache key of the file */
+    int modified;                                    /* Written since it was opened */
     struct _fs_dev_file_state_t *prevOpenFile;  /* The previous entry in a double-linked FILO list of open files */
     struct _fs_dev_file_state_t *nextOpenFile;  /* The next entry in a double-linked FILO list of open files */
 } fs_dev_file_state_t;
 
 typedef struct _fs_dev_dir_entry_t {
     fs_dev_private_t *dev;
+    int fsaFd;
     int dirHandle;
+    uint32_t mutex[(OS_MUTEX_SIZE + 3) >> 2];
+    uint32_t entry_idx;                         /* Next entry to hand out from the batch */
+    uint32_t entry_cnt;                         /* Entries in the batch */
+    int end_result;                             /* Status that ended the last batch early, e.g. end of directory */
+    directoryEntry_s entries[FS_DEV_DIR_BATCH];
 } fs_dev_dir_entry_t;
 
-static fs_dev_private_t *fs_dev_get_device_data(const char *path)
+//! hand out the device's FSA handles round-robin
+static int fs_dev_get_fsa(fs_dev_private_t *dev)
 {
-    const devoptab_t *devoptab = NULL;
-    char name[128] = {0};
-    int i;
+    if(dev->fsaCount <= 1)
+        return dev->fsaFd;
 
-    // Get the device name from the path
-    strncpy(name, path, 127);
-    strtok(name, ":/");
+    OSLockMutex(dev->lock.mutex);
+    int fsaFd = dev->fsaFds[dev->fsaNext];
+    if(++dev->fsaNext >= dev->fsaCount)
+        dev->fsaNext = 0;
+    OSUnlockMutex(dev->lock.mutex);
 
-    // Search the devoptab table for the specified device name
-    // NOTE: We do this manually due to a 'bug' in GetDeviceOpTab
-    //       which ignores names with suffixes and causes names
-    //       like "ntfs" and "ntfs1" to be seen as equals
-    for (i = 3; i < STD_MAX; i++) {
-        devoptab = devoptab_list[i];
-        if (devoptab && devoptab->name) {
-            if (strcmp(name, devoptab->name) == 0) {
-                return (fs_dev_private_t *)devoptab->deviceData;
-            }
+    return fsaFd;
+}
+
+static void fs_dev_rwlock_init(fs_dev_rwlock_t *lock)
+{
+    OSInitMutex(lock->mutex);
+    OSInitCond(lock->cond);
+    lock->readers = 0;
+    lock->writer = 0;
+}
+
+static void fs_dev_read_lock(fs_dev_rwlock_t *lock)
+{
+    OSLockMutex(lock->mutex);
+    while(lock->writer)
+        OSWaitCond(lock->cond, lock->mutex);
+    lock->readers++;
+    OSUnlockMutex(lock->mutex);
+}
+
+static void fs_dev_read_unlock(fs_dev_rwlock_t *lock)
+{
+    OSLockMutex(lock->mutex);
+    if(--lock->readers == 0)
+        OSSignalCond(lock->cond);
+    OSUnlockMutex(lock->mutex);
+}
+
+static void fs_dev_write_lock(fs_dev_rwlock_t *lock)
+{
+    OSLockMutex(lock->mutex);
+    while(lock->writer || lock->readers)
+        OSWaitCond(lock->cond, lock->mutex);
+    lock->writer = 1;
+    OSUnlockMutex(lock->mutex);
+}
+
+//! OSSignalCond wakes up all waiting threads, so readers and writers both get to re-check
+static void fs_dev_write_unlock(fs_dev_rwlock_t *lock)
+{
+    OSLockMutex(lock->mutex);
+    lock->writer = 0;
+    OSSignalCond(lock->cond);
+    OSUnlockMutex(lock->mutex);
+}
+
+//! Stat cache key of a path: repeated slashes, "." components and trailing slashes are dropped so
+//! "a//b", "./a/b" and "a/b/" all map to "/a/b". Returns -1 if the key does not fit FS_DEV_STAT_PATH_MAX.
+static int fs_dev_stat_key(const char *path, char *key)
+{
+    uint32_t len = 0;
+
+    while(*path)
+    {
+        if(*path == '/')
+        {
+            path++;
+            continue;
         }
+
+        const char *end = strchr(path, '/');
+        uint32_t n = end ? (uint32_t)(end - path) : strlen(path);
+
+        if(n != 1 || path[0] != '.')
+        {
+            if(len + 1 + n >= FS_DEV_STAT_PATH_MAX)
+                return -1;
+
+            key[len++] = '/';
+            memcpy(key + len, path, n);
+            len += n;
+        }
+
+        path += n;
+    }
+
+    if(len == 0)
+        key[len++] = '/';
+
+    key[len] = 0;
+    return 0;
+}
+
+static uint32_t fs_dev_hash_key(const char *key)
+{
+    uint32_t hash = 2166136261u;
+
+    while(*key)
+        hash = (hash ^ (uint8_t)*key++) * 16777619u;
+
+    return hash;
+}
+
+//! hash of the stat cache key of path, paths too long to be cached hash to 0
+static uint32_t fs_dev_hash_path(const char *path)
+{
+    char key[FS_DEV_STAT_PATH_MAX];
+
+    if(fs_dev_stat_key(path, key) < 0)
+        return 0;
+
+    return fs_dev_hash_key(key);
+}
+
+static void fs_dev_stat_lru_unlink(fs_dev_stat_cache_t *cache, fs_dev_stat_entry_t *entry)
+{
+    if(entry->lru_prev)
+        entry->lru_prev->lru_next = entry->lru_next;
+    else
+        cache->lru_head = entry->lru_next;
+
+    if(entry->lru_next)
+        entry->lru_next->lru_prev = entry->lru_prev;
+    else
+        cache->lru_tail = entry->lru_prev;
+}
+
+static void fs_dev_stat_lru_push_front(fs_dev_stat_cache_t *cache, fs_dev_stat_entry_t *entry)
+{
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if(cache->lru_head)
+        cache->lru_head->lru_prev = entry;
+    else
+        cache->lru_tail = entry;
+    cache->lru_head = entry;
+}
+
+static void fs_dev_stat_lru_push_back(fs_dev_stat_cache_t *cache, fs_dev_stat_entry_t *entry)
+{
+    entry->lru_next = NULL;
+    entry->lru_prev = cache->lru_tail;
+    if(cache->lru_tail)
+        cache->lru_tail->lru_next = entry;
+    else
+        cache->lru_head = entry;
+    cache->lru_tail = entry;
+}
+
+//! take the entry out of its bucket and make it the first one to be reused
+static void fs_dev_stat_drop(fs_dev_stat_cache_t *cache, fs_dev_stat_entry_t *entry)
+{
+    fs_dev_stat_entry_t **link = &cache->buckets[entry->hash & cache->bucket_mask];
+
+    while(*link != entry)
+        link = &(*link)->hash_next;
+
+    *link = entry->hash_next;
+    entry->in_use = 0;
+
+    fs_dev_stat_lru_unlink(cache, entry);
+    fs_dev_stat_lru_push_back(cache, entry);
+}
+
+static int fs_dev_stat_cache_init(fs_dev_stat_cache_t *cache, uint32_t count, uint32_t ttl_ms)
+{
+    memset(cache, 0, sizeof(fs_dev_stat_cache_t));
+    OSInitMutex(cache->mutex);
+
+    if(!count)
+        return 0;
+
+    uint32_t bucket_cnt = 1;
+    while(bucket_cnt < count)
+        bucket_cnt <<= 1;
+
+    cache->entries = (fs_dev_stat_entry_t*)malloc(count * sizeof(fs_dev_stat_entry_t));
+    cache->buckets = (fs_dev_stat_entry_t**)malloc(bucket_cnt * sizeof(fs_dev_stat_entry_t*));
+    if(!cache->entries || !cache->buckets)
+    {
+        free(cache->entries);
+        free(cache->buckets);
+        cache->entries = NULL;
+        cache->buckets = NULL;
+        return -1;
+    }
+
+    memset(cache->buckets, 0, bucket_cnt * sizeof(fs_dev_stat_entry_t*));
+    cache->bucket_mask = bucket_cnt - 1;
+    cache->ttl = (long long)ttl_ms * (OS_TIMER_CLOCK / 1000);
+
+    uint32_t i;
+    for(i = 0; i < count; i++)
+    {
+        cache->entries[i].in_use = 0;
+        fs_dev_stat_lru_push_back(cache, &cache->entries[i]);
+    }
+
+    return 0;
+}
+
+static void fs_dev_stat_cache_free(fs_dev_stat_cache_t *cache)
+{
+    free(cache->entries);
+    free(cache->buckets);
+    cache->entries = NULL;
+    cache->buckets = NULL;
+}
+
+//! returns 1 and the cached GetStat result on a hit
+static int fs_dev_stat_cache_lookup(fs_dev_stat_cache_t *cache, const char *path, uint32_t hash, fileStat_s *stats, int *result)
+{
+    if(!cache->entries)
+        return 0;
+
+    int hit = 0;
+
+    OSLockMutex(cache->mutex);
+
+    fs_dev_stat_entry_t *entry = cache->buckets[hash & cache->bucket_mask];
+    while(entry)
+    {
+        if(entry->hash == hash && strcmp(entry->path, path) == 0)
+            break;
+        entry = entry->hash_next;
+    }
+
+    if(entry)
+    {
+        if(cache->ttl && (OSGetTime() - entry->time) >= cache->ttl)
+        {
+            fs_dev_stat_drop(cache, entry);
+        }
+        else
+        {
+            fs_dev_stat_lru_unlink(cache, entry);
+            fs_dev_stat_lru_push_front(cache, entry);
+
+            *result = entry->result;
+            memcpy(stats, &entry->stats, sizeof(fileStat_s));
+            hit = 1;
+        }
+    }
+
+    OSUnlockMutex(cache->mutex);
+    return hit;
+}
+
+//! generation is the value read before the GetStat, results that raced an invalidation are not stored
+static void fs_dev_stat_cache_store(fs_dev_stat_cache_t *cache, const char *path, uint32_t hash, uint32_t generation, const fileStat_s *stats, int result)
+{
+    if(!cache->entries || strlen(path) >= FS_DEV_STAT_PATH_MAX)
+        return;
+
+    if(result < 0 && result != FSA_STATUS_NOT_FOUND)
+        return;
+
+    OSLockMutex(cache->mutex);
+
+    if(generation == cache->generation)
+    {
+        // reuse the least recently used entry
+        fs_dev_stat_entry_t *entry = cache->lru_tail;
+        if(entry->in_use)
+            fs_dev_stat_drop(cache, entry);
+
+        entry->in_use = 1;
+        entry->hash = hash;
+        entry->result = result;
+        entry->time = cache->ttl ? OSGetTime() : 0;
+        strcpy(entry->path, path);
+        if(result >= 0)
+            memcpy(&entry->stats, stats, sizeof(fileStat_s));
+
+        fs_dev_stat_entry_t **bucket = &cache->buckets[hash & cache->bucket_mask];
+        entry->hash_next = *bucket;
+        *bucket = entry;
+
+        fs_dev_stat_lru_unlink(cache, entry);
+        fs_dev_stat_lru_push_front(cache, entry);
+    }
+
+    OSUnlockMutex(cache->mutex);
+}
+
+static uint32_t fs_dev_stat_cache_generation(fs_dev_stat_cache_t *cache)
+{
+    OSLockMutex(cache->mutex);
+    uint32_t generation = cache->generation;
+    OSUnlockMutex(cache->mutex);
+    return generation;
+}
+
+//! drop every entry with the given hash, that covers the path and the rare collisions with it
+static void fs_dev_stat_cache_invalidate(fs_dev_stat_cache_t *cache, uint32_t hash)
+{
+    if(!cache->entries)
+        return;
+
+    OSLockMutex(cache->mutex);
+
+    fs_dev_stat_entry_t *entry = cache->buckets[hash & cache->bucket_mask];
+    while(entry)
+    {
+        fs_dev_stat_entry_t *next = entry->hash_next;
+        if(entry->hash == hash)
+            fs_dev_stat_drop(cache, entry);
+        entry = next;
+    }
+
+    cache->generation++;
+
+    OSUnlockMutex(cache->mutex);
+}
+
+//! used when a whole subtree may have changed
+static void fs_dev_stat_cache_clear(fs_dev_stat_cache_t *cache)
+{
+    if(!cache->entries)
+        return;
+
+    OSLockMutex(cache->mutex);
+
+    fs_dev_stat_entry_t *entry = cache->lru_head;
+    while(entry)
+    {
+        fs_dev_stat_entry_t *next = entry->lru_next;
+        if(entry->in_use)
+            fs_dev_stat_drop(cache, entry);
+        entry = next;
+    }
+
+    cache->generation++;
+
+    OSUnlockMutex(cache->mutex);
+}
+
+//! hash the device name at the start of path, it ends at the first ':' or '/'
+static uint32_t fs_dev_hash_name(const char **path, uint32_t *len)
+{
+    const char *name = *path;
+
+    // skip leading separators the same way strtok did
+    while(*name == ':' || *name == '/')
+        name++;
+
+    uint32_t hash = 2166136261u;
+    uint32_t i = 0;
+
+    while(name[i] && name[i] != ':' && name[i] != '/')
+    {
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+        i++;
+    }
+
+    *path = name;
+    *len = i;
+    return hash;
+}
+
+static fs_dev_private_t *fs_dev_get_device_data(const char *path)
+{
+    uint32_t len;
+    uint32_t hash = fs_dev_hash_name(&path, &len);
+
+    fs_dev_private_t *priv = fs_dev_registry[hash & (FS_DEV_REGISTRY_BUCKETS - 1)];
+
+    while(priv)
+    {
+        if(priv->name_hash == hash && priv->name_len == len && memcmp(priv->name, path, len) == 0)
+            return priv;
+
+        priv = priv->next;
     }
 
     return NULL;
 }
 
-static char *fs_dev_real_path (const char *path, fs_dev_private_t *dev)
+//! devices are appended to their bucket, so the first one mounted wins like it did with the table scan
+static void fs_dev_registry_add(fs_dev_private_t *priv)
 {
-    // Sanity check
-    if (!path)
-        return NULL;
+    fs_dev_private_t **link = &fs_dev_registry[priv->name_hash & (FS_DEV_REGISTRY_BUCKETS - 1)];
+
+    while(*link)
+        link = &(*link)->next;
+
+    priv->next = NULL;
+    *link = priv;
+}
+
+static void fs_dev_registry_remove(fs_dev_private_t *priv)
+{
+    fs_dev_private_t **link = &fs_dev_registry[priv->name_hash & (FS_DEV_REGISTRY_BUCKETS - 1)];
+
+    while(*link)
+    {
+        if(*link == priv)
+        {
+            *link = priv->next;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+//! the part of the path behind the device name, the ioctl wrappers put the mount path in front of it
+static const char *fs_dev_rel_path(const char *path)
+{
+    const char *sep = strchr(path, ':');
+    return sep ? sep + 1 : path;
+}
+
+//! move the FSA file position to pos, skipped if it is already there
+static int fs_dev_sync_pos(fs_dev_file_state_t *file, uint32_t pos)
+{
+    if(file->dev_pos == pos)
+        return 0;
+
+    // the seek that asked for this position already returned, report it as an invalid seek
+    int result = IOSUHAX_FSA_SetFilePos(file->fsaFd, file->fd, pos);
+    if(result < 0)
+        return -EINVAL;
+
+    file->dev_pos = pos;
+    return 0;
+}
+
+static int fs_dev_read_direct(fs_dev_file_state_t *file, uint32_t pos, char *ptr, size_t len)
+{
+    int result = fs_dev_sync_pos(file, pos);
+    if(result < 0)
+        return result;
+
+    size_t done = 0;
+
+    while(done < len)
+    {
+        result = IOSUHAX_FSA_ReadFile(file->fsaFd, ptr + done, 0x01, len - done, file->fd, 0);
+        if(result < 0)
+            return result;
+        else if(result == 0)
+            break;
+
+        done += result;
+        file->dev_pos += result;
+    }
+
+    return done;
+}
+
+static int fs_dev_write_direct(fs_dev_file_state_t *file, uint32_t pos, const char *ptr, size_t len)
+{
+    int result = fs_dev_sync_pos(file, pos);
+    if(result < 0)
+        return result;
+
+    size_t done = 0;
+
+    while(done < len)
+    {
+        result = IOSUHAX_FSA_WriteFile(file->fsaFd, ptr + done, 0x01, len - done, file->fd, 0);
+        if(result < 0)
+            return result;
+        else if(result == 0)
+            break;
+
+        done += result;
+        file->dev_pos += result;
+    }
+
+    return done;
+}
+
+//! write back the dirty range of the cache, the cached data stays valid
+static int fs_dev_flush(fs_dev_file_state_t *file)
+{
+    if(file->dirty_start != file->dirty_end)
+    {
+        uint32_t size = file->dirty_end - file->dirty_start;
+
+        int result = fs_dev_write_direct(file, file->cache_pos + file->dirty_start, file->cache + file->dirty_start, size);
+        if(result < 0)
+            return result;
+        if((uint32_t)result != size)
+            return -EIO;
+
+        file->dirty_start = 0;
+        file->dirty_end = 0;
+    }
+
+    // writes are published to the stat cache once per flush instead of on every call
+    if(file->modified)
+    {
+        fs_dev_stat_cache_invalidate(&file->dev->stat_cache, file->path_hash);
+        file->modified = 0;
+    }
+
+    return 0;
+}
+
+static int fs_dev_read_cached(fs_dev_file_state_t *file, char *ptr, size_t len)
+{
+    size_t done = 0;
 
-    // Move the path pointer to the start of the actual path
-    if (strchr(path, ':') != NULL) {
-        path = strchr(path, ':') + 1;
+    while(done < len)
+    {
+        uint32_t cache_end = file->cache_pos + file->cache_len;
+
+        if(file->pos >= file->cache_pos && file->pos < cache_end)
+        {
+            size_t copy = cache_end - file->pos;
+            if(copy > len - done)
+                copy = len - done;
+
+            memcpy(ptr + done, file->cache + (file->pos - file->cache_pos), copy);
+            done += copy;
+            file->pos += copy;
+            continue;
+        }
+
+        // the buffer is about to be refilled, write back pending data first
+        int result = fs_dev_flush(file);
+        if(result < 0)
+            return result;
+
+        // sequential reads double the read-ahead window, anything else starts over
+        if(file->pos == file->ra_next && file->ra_size)
+        {
+            file->ra_size <<= 1;
+            if(file->ra_size > file->cache_size)
+                file->ra_size = file->cache_size;
+        }
+        else
+        {
+            file->ra_size = (FS_DEV_READ_AHEAD_MIN < file->cache_size) ? FS_DEV_READ_AHEAD_MIN : file->cache_size;
+        }
+
+        size_t remaining = len - done;
+
+        // requests that do not fit the cache go straight to the caller's buffer
+        if(remaining >= file->cache_size)
+        {
+            result = fs_dev_read_direct(file, file->pos, ptr + done, remaining);
+            if(result < 0)
+                return result;
+
+            done += result;
+            file->pos += result;
+            file->ra_next = file->pos;
+            break;
+        }
+
+        uint32_t fill = (remaining > file->ra_size) ? remaining : file->ra_size;
+
+        result = fs_dev_read_direct(file, file->pos, file->cache, fill);
+        if(result < 0)
+        {
+            file->cache_len = 0;
+            return result;
+        }
+
+        file->cache_pos = file->pos;
+        file->cache_len = result;
+        file->ra_next = file->pos + result;
+
+        if(result == 0)
+            break;
     }
 
-    int mount_len = strlen(dev->mount_path);
+    return done;
+}
+
+static int fs_dev_write_cached(fs_dev_file_state_t *file, const char *ptr, size_t len)
+{
+    int result;
+
+    // large writes go straight through, pending data is written first to keep the order
+    if(len >= file->cache_size)
+    {
+        result = fs_dev_flush(file);
+        if(result < 0)
+            return result;
+
+        result = fs_dev_write_direct(file, file->pos, ptr, len);
+        if(result < 0)
+            return result;
+
+        // drop cached data that was just overwritten
+        if(file->pos < file->cache_pos + file->cache_len && file->pos + result > file->cache_pos)
+            file->cache_len = 0;
 
-    char *new_name = (char*)malloc(mount_len + strlen(path) + 1);
-    if(new_name) {
-        strcpy(new_name, dev->mount_path);
-        strcpy(new_name + mount_len, path);
-        return new_name;
+        file->pos += result;
+        return result;
     }
-    return new_name;
+
+    size_t done = 0;
+
+    while(done < len)
+    {
+        uint32_t offset = file->pos - file->cache_pos;
+
+        // writes are gathered as long as they overwrite or extend the cached range
+        if(file->pos < file->cache_pos || offset > file->cache_len || offset >= file->cache_size)
+        {
+            result = fs_dev_flush(file);
+            if(result < 0)
+                return done ? (int)done : result;
+
+            file->cache_pos = file->pos;
+            file->cache_len = 0;
+            offset = 0;
+        }
+
+        size_t copy = file->cache_size - offset;
+        if(copy > len - done)
+            copy = len - done;
+
+        memcpy(file->cache + offset, ptr + done, copy);
+
+        if(file->dirty_start == file->dirty_end)
+        {
+            file->dirty_start = offset;
+            file->dirty_end = offset + copy;
+        }
+        else
+        {
+            if(offset < file->dirty_start)
+                file->dirty_start = offset;
+            if(offset + copy > file->dirty_end)
+                file->dirty_end = offset + copy;
+        }
+
+        if(offset + copy > file->cache_len)
+            file->cache_len = offset + copy;
+
+        done += copy;
+        file->pos += copy;
+    }
+
+    return done;
 }
 
 static int fs_dev_open_r (struct _reent *r, void *fileStruct, const char *path, int flags, int mode)
@@ -143,40 +812,58 @@ static int fs_dev_open_r (struct _reent *r, void *fileStruct, const char *path,
         return -1;
     }
 
+    if(file->write && dev->read_only) {
+        r->_errno = EROFS;
+        return -1;
+    }
+
     int fd = -1;
 
-    OSLockMutex(dev->pMutex);
+    fs_dev_read_lock(&dev->lock);
 
-    char *real_path = fs_dev_real_path(path, dev);
-    if(!path) {
-        r->_errno = ENOMEM;
-        OSUnlockMutex(dev->pMutex);
-        return -1;
-    }
+    const char *rel_path = fs_dev_rel_path(path);
+
+    int fsaFd = fs_dev_get_fsa(dev);
 
-    int result = IOSUHAX_FSA_OpenFile(dev->fsaFd, real_path, mode_str, &fd);
+    int result = iosuhax_fsa_open_file(IOSUHAX_GetDefaultCtx(), fsaFd, dev->mount_path, rel_path, mode_str, &fd);
 
-    free(real_path);
+    // opening for writing may have created or truncated the file
+    if(file->write)
+        fs_dev_stat_cache_invalidate(&dev->stat_cache, fs_dev_hash_path(rel_path));
 
     if(result == 0)
     {
         fileStat_s stats;
-        result = IOSUHAX_FSA_StatFile(dev->fsaFd, fd, &stats);
+        result = IOSUHAX_FSA_StatFile(fsaFd, fd, &stats);
         if(result != 0) {
-            IOSUHAX_FSA_CloseFile(dev->fsaFd, fd);
+            IOSUHAX_FSA_CloseFile(fsaFd, fd);
             r->_errno = result;
-            OSUnlockMutex(dev->pMutex);
+            fs_dev_read_unlock(&dev->lock);
             return -1;
         }
+        file->fsaFd = fsaFd;
         file->fd = fd;
+        file->path_hash = fs_dev_hash_path(rel_path);
+        file->modified = 0;
         file->pos = 0;
         file->len = stats.size;
-        OSUnlockMutex(dev->pMutex);
+        file->dev_pos = 0;
+        file->cache_pos = 0;
+        file->cache_len = 0;
+        file->dirty_start = 0;
+        file->dirty_end = 0;
+        file->ra_size = 0;
+        file->ra_next = 0;
+        file->cache_size = dev->file_cache_size;
+        // without a cache buffer the file simply runs uncached
+        file->cache = file->cache_size ? (char*)memalign(0x40, file->cache_size) : NULL;
+        OSInitMutex(file->mutex);
+        fs_dev_read_unlock(&dev->lock);
         return (int)file;
     }
 
     r->_errno = result;
-    OSUnlockMutex(dev->pMutex);
+    fs_dev_read_unlock(&dev->lock);
     return -1;
 }
 
@@ -189,11 +876,26 @@ static int fs_dev_close_r (struct _reent *r, void *fd)
         return -1;
     }
 
-    OSLockMutex(file->dev->pMutex);
+    OSLockMutex(file->mutex);
+
+    int flush_result = fs_dev_flush(file);
+
+    int result = IOSUHAX_FSA_CloseFile(file->fsaFd, file->fd);
+
+    // write-back data and the final size only reach the file now
+    if(file->modified)
+        fs_dev_stat_cache_invalidate(&file->dev->stat_cache, file->path_hash);
 
-    int result = IOSUHAX_FSA_CloseFile(file->dev->fsaFd, file->fd);
+    OSUnlockMutex(file->mutex);
 
-    OSUnlockMutex(file->dev->pMutex);
+    if(file->cache)
+    {
+        free(file->cache);
+        file->cache = NULL;
+    }
+
+    if(result >= 0)
+        result = flush_result;
 
     if(result < 0)
     {
@@ -203,6 +905,7 @@ static int fs_dev_close_r (struct _reent *r, void *fd)
     return 0;
 }
 
+//! The position is only tracked here, read and write move the FSA file position when they need to.
 static off_t fs_dev_seek_r (struct _reent *r, void *fd, off_t pos, int dir)
 {
     fs_dev_file_state_t *file = (fs_dev_file_state_t *)fd;
@@ -211,34 +914,67 @@ static off_t fs_dev_seek_r (struct _reent *r, void *fd, off_t pos, int dir)
         return 0;
     }
 
-    OSLockMutex(file->dev->pMutex);
+    OSLockMutex(file->mutex);
+
+    // computed in 64 bit so offsets beyond the 32 bit FSA file position can be told apart
+    int64_t new_pos;
 
     switch(dir)
     {
     case SEEK_SET:
-        file->pos = pos;
+        new_pos = pos;
         break;
     case SEEK_CUR:
-        file->pos += pos;
+        new_pos = (int64_t)file->pos + pos;
         break;
     case SEEK_END:
-        file->pos = file->len + pos;
+        new_pos = (int64_t)file->len + pos;
         break;
     default:
         r->_errno = EINVAL;
+        OSUnlockMutex(file->mutex);
         return -1;
     }
 
-    int result = IOSUHAX_FSA_SetFilePos(file->dev->fsaFd, file->fd, file->pos);
+    if(new_pos < 0)
+    {
+        r->_errno = EINVAL;
+        OSUnlockMutex(file->mutex);
+        return -1;
+    }
 
-    OSUnlockMutex(file->dev->pMutex);
+    if(new_pos > 0xFFFFFFFFLL || (off_t)new_pos != new_pos)
+    {
+        r->_errno = EOVERFLOW;
+        OSUnlockMutex(file->mutex);
+        return -1;
+    }
 
-    if(result == 0)
+    // SetFilePos is deferred to the next transfer, reject what FSA would refuse there
+    if(new_pos > file->len)
     {
-        return file->pos;
+        r->_errno = EINVAL;
+        OSUnlockMutex(file->mutex);
+        return -1;
     }
 
-    return result;
+    // pure position queries like ftell leave pending writes alone
+    if((uint32_t)new_pos != file->pos)
+    {
+        int result = fs_dev_flush(file);
+        if(result < 0)
+        {
+            r->_errno = result;
+            OSUnlockMutex(file->mutex);
+            return -1;
+        }
+
+        file->pos = (uint32_t)new_pos;
+    }
+
+    OSUnlockMutex(file->mutex);
+
+    return (off_t)new_pos;
 }
 
 static ssize_t fs_dev_write_r (struct _reent *r, void *fd, const char *ptr, size_t len)
@@ -255,34 +991,38 @@ static ssize_t fs_dev_write_r (struct _reent *r, void *fd, const char *ptr, size
         return 0;
     }
 
-    OSLockMutex(file->dev->pMutex);
+    OSLockMutex(file->mutex);
 
-    size_t done = 0;
+    // appending files are always written at their end
+    if(file->append)
+        file->pos = file->len;
 
-    while(done < len)
-    {
-        size_t write_size = len - done;
+    int result;
 
-        int result = IOSUHAX_FSA_WriteFile(file->dev->fsaFd, ptr + done, 0x01, write_size, file->fd, 0);
-        if(result < 0)
-        {
-            r->_errno = result;
-            break;
-        }
-        else if(result == 0)
-        {
-            if(write_size > 0)
-                done = 0;
-            break;
-        }
-        else
-        {
-            done += result;
+    if(file->cache)
+    {
+        result = fs_dev_write_cached(file, ptr, len);
+    }
+    else
+    {
+        result = fs_dev_write_direct(file, file->pos, ptr, len);
+        if(result > 0)
             file->pos += result;
-        }
     }
 
-    OSUnlockMutex(file->dev->pMutex);
+    size_t done = 0;
+
+    if(result < 0)
+        r->_errno = result;
+    else
+        done = result;
+
+    if(file->pos > file->len)
+        file->len = file->pos;
+
+    file->modified = 1;
+
+    OSUnlockMutex(file->mutex);
     return done;
 }
 
@@ -300,34 +1040,29 @@ static ssize_t fs_dev_read_r (struct _reent *r, void *fd, char *ptr, size_t len)
         return 0;
     }
 
-    OSLockMutex(file->dev->pMutex);
+    OSLockMutex(file->mutex);
 
-    size_t done = 0;
+    int result;
 
-    while(done < len)
+    if(file->cache)
     {
-        size_t read_size = len - done;
-
-        int result = IOSUHAX_FSA_ReadFile(file->dev->fsaFd, ptr + done, 0x01, read_size, file->fd, 0);
-        if(result < 0)
-        {
-            r->_errno = result;
-            done = 0;
-            break;
-        }
-        else if(result == 0)
-        {
-            //! TODO: error on read_size > 0
-            break;
-        }
-        else
-        {
-            done += result;
+        result = fs_dev_read_cached(file, ptr, len);
+    }
+    else
+    {
+        result = fs_dev_read_direct(file, file->pos, ptr, len);
+        if(result > 0)
             file->pos += result;
-        }
     }
 
-    OSUnlockMutex(file->dev->pMutex);
+    size_t done = 0;
+
+    if(result < 0)
+        r->_errno = result;
+    else
+        done = result;
+
+    OSUnlockMutex(file->mutex);
     return done;
 }
 
@@ -340,16 +1075,19 @@ static int fs_dev_fstat_r (struct _reent *r, void *fd, struct stat *st)
         return -1;
     }
 
-    OSLockMutex(file->dev->pMutex);
+    OSLockMutex(file->mutex);
 
     // Zero out the stat buffer
     memset(st, 0, sizeof(struct stat));
 
+    // pending writes have to reach the file before its size is queried
     fileStat_s stats;
-    int result = IOSUHAX_FSA_StatFile(file->dev->fsaFd, (int)fd, &stats);
+    int result = fs_dev_flush(file);
+    if(result == 0)
+        result = IOSUHAX_FSA_StatFile(file->fsaFd, file->fd, &stats);
     if(result != 0) {
         r->_errno = result;
-        OSUnlockMutex(file->dev->pMutex);
+        OSUnlockMutex(file->mutex);
         return -1;
     }
 
@@ -366,7 +1104,7 @@ static int fs_dev_fstat_r (struct _reent *r, void *fd, struct stat *st)
     st->st_atime = stats.mtime;
     st->st_ctime = stats.ctime;
     st->st_mtime = stats.mtime;
-    OSUnlockMutex(file->dev->pMutex);
+    OSUnlockMutex(file->mutex);
     return 0;
 }
 
@@ -391,9 +1129,18 @@ static int fs_dev_fsync_r (struct _reent *r, void *fd)
         return -1;
     }
 
-    r->_errno = ENOTSUP;
-    // TODO
-    return -1;
+    OSLockMutex(file->mutex);
+
+    int result = fs_dev_flush(file);
+
+    OSUnlockMutex(file->mutex);
+
+    if(result < 0) {
+        r->_errno = result;
+        return -1;
+    }
+
+    return 0;
 }
 
 static int fs_dev_stat_r (struct _reent *r, const char *path, struct stat *st)
@@ -404,32 +1151,38 @@ static int fs_dev_stat_r (struct _reent *r, const char *path, struct stat *st)
         return -1;
     }
 
-    OSLockMutex(dev->pMutex);
+    fs_dev_read_lock(&dev->lock);
 
     // Zero out the stat buffer
     memset(st, 0, sizeof(struct stat));
 
-    char *real_path = fs_dev_real_path(path, dev);
-    if(!real_path) {
-        r->_errno = ENOMEM;
-        OSUnlockMutex(dev->pMutex);
-        return -1;
-    }
+    const char *rel_path = fs_dev_rel_path(path);
 
     fileStat_s stats;
+    int result;
+
+    char key[FS_DEV_STAT_PATH_MAX];
+    int cacheable = (fs_dev_stat_key(rel_path, key) == 0);
+    uint32_t hash = cacheable ? fs_dev_hash_key(key) : 0;
 
-    int result = IOSUHAX_FSA_GetStat(dev->fsaFd, real_path, &stats);
+    if(!cacheable || !fs_dev_stat_cache_lookup(&dev->stat_cache, key, hash, &stats, &result))
+    {
+        uint32_t generation = fs_dev_stat_cache_generation(&dev->stat_cache);
+
+        result = iosuhax_fsa_get_stat(IOSUHAX_GetDefaultCtx(), fs_dev_get_fsa(dev), dev->mount_path, rel_path, &stats);
 
-    free(real_path);
+        if(cacheable)
+            fs_dev_stat_cache_store(&dev->stat_cache, key, hash, generation, &stats, result);
+    }
 
     if(result < 0) {
         r->_errno = result;
-        OSUnlockMutex(dev->pMutex);
+        fs_dev_read_unlock(&dev->lock);
         return -1;
     }
 
     // mark root also as directory
-    st->st_mode = ((stats.flag & 0x80000000) || (strlen(dev->mount_path) + 1 == strlen(real_path)))? S_IFDIR : S_IFREG;
+    st->st_mode = ((stats.flag & 0x80000000) || (rel_path[0] == '/' && rel_path[1] == 0))? S_IFDIR : S_IFREG;
     st->st_nlink = 1;
     st->st_size = stats.size;
     st->st_blocks = (stats.size + 511) >> 9;
@@ -442,7 +1195,7 @@ static int fs_dev_stat_r (struct _reent *r, const char *path, struct stat *st)
     st->st_ctime = stats.ctime;
     st->st_mtime = stats.mtime;
 
-    OSUnlockMutex(dev->pMutex);
+    fs_dev_read_unlock(&dev->lock);
 
     return 0;
 }
@@ -461,20 +1214,20 @@ static int fs_dev_unlink_r (struct _reent *r, const char *name)
         return -1;
     }
 
-    OSLockMutex(dev->pMutex);
-
-    char *real_path = fs_dev_real_path(name, dev);
-    if(!real_path) {
-        r->_errno = ENOMEM;
-        OSUnlockMutex(dev->pMutex);
+    if(dev->read_only) {
+        r->_errno = EROFS;
         return -1;
     }
 
-    int result = IOSUHAX_FSA_Remove(dev->fsaFd, real_path);
+    fs_dev_write_lock(&dev->lock);
 
-    free(real_path);
+    const char *rel_path = fs_dev_rel_path(name);
 
-    OSUnlockMutex(dev->pMutex);
+    int result = iosuhax_fsa_remove(IOSUHAX_GetDefaultCtx(), fs_dev_get_fsa(dev), dev->mount_path, rel_path);
+
+    fs_dev_stat_cache_invalidate(&dev->stat_cache, fs_dev_hash_path(rel_path));
+
+    fs_dev_write_unlock(&dev->lock);
 
     if(result < 0) {
         r->_errno = result;
@@ -492,20 +1245,13 @@ static int fs_dev_chdir_r (struct _reent *r, const char *name)
         return -1;
     }
 
-    OSLockMutex(dev->pMutex);
+    fs_dev_read_lock(&dev->lock);
 
-    char *real_path = fs_dev_real_path(name, dev);
-    if(!real_path) {
-        r->_errno = ENOMEM;
-        OSUnlockMutex(dev->pMutex);
-        return -1;
-    }
-
-    int result = IOSUHAX_FSA_ChangeDir(dev->fsaFd, real_path);
+    const char *rel_path = fs_dev_rel_path(name);
 
-    free(real_path);
+    int result = iosuhax_fsa_change_dir(IOSUHAX_GetDefaultCtx(), dev->fsaFd, dev->mount_path, rel_path);
 
-    OSUnlockMutex(dev->pMutex);
+    fs_dev_read_unlock(&dev->lock);
 
     if(result < 0) {
         r->_errno = result;
@@ -523,29 +1269,28 @@ static int fs_dev_rename_r (struct _reent *r, const char *oldName, const char *n
         return -1;
     }
 
-    OSLockMutex(dev->pMutex);
-
-    char *real_oldpath = fs_dev_real_path(oldName, dev);
-    if(!real_oldpath) {
-        r->_errno = ENOMEM;
-        OSUnlockMutex(dev->pMutex);
+    // FSA can only move entries within one volume
+    if(strchr(newName, ':') && fs_dev_get_device_data(newName) != dev) {
+        r->_errno = EXDEV;
         return -1;
     }
-    char *real_newpath = fs_dev_real_path(newName, dev);
-    if(!real_newpath) {
-        r->_errno = ENOMEM;
-        free(real_oldpath);
-        OSUnlockMutex(dev->pMutex);
+
+    if(dev->read_only) {
+        r->_errno = EROFS;
         return -1;
     }
 
-    //! TODO
-    int result = -ENOTSUP;
+    fs_dev_write_lock(&dev->lock);
 
-    free(real_oldpath);
-    free(real_newpath);
+    const char *rel_oldpath = fs_dev_rel_path(oldName);
+    const char *rel_newpath = fs_dev_rel_path(newName);
 
-    OSUnlockMutex(dev->pMutex);
+    int result = iosuhax_fsa_rename(IOSUHAX_GetDefaultCtx(), fs_dev_get_fsa(dev), dev->mount_path, rel_oldpath, rel_newpath);
+
+    // a renamed directory moves everything below it
+    fs_dev_stat_cache_clear(&dev->stat_cache);
+
+    fs_dev_write_unlock(&dev->lock);
 
     if(result < 0) {
         r->_errno = result;
@@ -553,7 +1298,6 @@ static int fs_dev_rename_r (struct _reent *r, const char *oldName, const char *n
     }
 
     return 0;
-
 }
 
 static int fs_dev_mkdir_r (struct _reent *r, const char *path, int mode)
@@ -564,20 +1308,20 @@ static int fs_dev_mkdir_r (struct _reent *r, const char *path, int mode)
         return -1;
     }
 
-    OSLockMutex(dev->pMutex);
-
-    char *real_path = fs_dev_real_path(path, dev);
-    if(!real_path) {
-        r->_errno = ENOMEM;
-        OSUnlockMutex(dev->pMutex);
+    if(dev->read_only) {
+        r->_errno = EROFS;
         return -1;
     }
 
-    int result = IOSUHAX_FSA_MakeDir(dev->fsaFd, real_path, mode);
+    fs_dev_write_lock(&dev->lock);
+
+    const char *rel_path = fs_dev_rel_path(path);
 
-    free(real_path);
+    int result = iosuhax_fsa_make_dir(IOSUHAX_GetDefaultCtx(), fs_dev_get_fsa(dev), dev->mount_path, rel_path, mode);
 
-    OSUnlockMutex(dev->pMutex);
+    fs_dev_stat_cache_invalidate(&dev->stat_cache, fs_dev_hash_path(rel_path));
+
+    fs_dev_write_unlock(&dev->lock);
 
     if(result < 0) {
         r->_errno = result;
@@ -595,20 +1339,20 @@ static int fs_dev_chmod_r (struct _reent *r, const char *path, int mode)
         return -1;
     }
 
-    OSLockMutex(dev->pMutex);
-
-    char *real_path = fs_dev_real_path(path, dev);
-    if(!real_path) {
-        r->_errno = ENOMEM;
-        OSUnlockMutex(dev->pMutex);
+    if(dev->read_only) {
+        r->_errno = EROFS;
         return -1;
     }
 
-    int result = IOSUHAX_FSA_ChangeMode(dev->fsaFd, real_path, mode);
+    fs_dev_write_lock(&dev->lock);
 
-    free(real_path);
+    const char *rel_path = fs_dev_rel_path(path);
 
-    OSUnlockMutex(dev->pMutex);
+    int result = iosuhax_fsa_change_mode(IOSUHAX_GetDefaultCtx(), fs_dev_get_fsa(dev), dev->mount_path, rel_path, mode);
+
+    fs_dev_stat_cache_invalidate(&dev->stat_cache, fs_dev_hash_path(rel_path));
+
+    fs_dev_write_unlock(&dev->lock);
 
     if(result < 0) {
         r->_errno = result;
@@ -626,27 +1370,20 @@ static int fs_dev_statvfs_r (struct _reent *r, const char *path, struct statvfs
         return -1;
     }
 
-    OSLockMutex(dev->pMutex);
+    fs_dev_read_lock(&dev->lock);
 
     // Zero out the stat buffer
     memset(buf, 0, sizeof(struct statvfs));
 
-    char *real_path = fs_dev_real_path(path, dev);
-    if(!real_path) {
-        r->_errno = ENOMEM;
-        OSUnlockMutex(dev->pMutex);
-        return -1;
-    }
+    const char *rel_path = fs_dev_rel_path(path);
 
     uint64_t size;
 
-    int result = IOSUHAX_FSA_GetDeviceInfo(dev->fsaFd, real_path, 0x00, (uint32_t*)&size);
-
-    free(real_path);
+    int result = iosuhax_fsa_get_device_info(IOSUHAX_GetDefaultCtx(), fs_dev_get_fsa(dev), dev->mount_path, rel_path, 0x00, (uint32_t*)&size);
 
     if(result < 0) {
         r->_errno = result;
-        OSUnlockMutex(dev->pMutex);
+        fs_dev_read_unlock(&dev->lock);
         return -1;
     }
 
@@ -677,7 +1414,7 @@ static int fs_dev_statvfs_r (struct _reent *r, const char *path, struct statvfs
     // Maximum length of filenames
     buf->f_namemax = 255;
 
-    OSUnlockMutex(dev->pMutex);
+    fs_dev_read_unlock(&dev->lock);
 
     return 0;
 }
@@ -692,22 +1429,17 @@ static DIR_ITER *fs_dev_diropen_r (struct _reent *r, DIR_ITER *dirState, const c
 
     fs_dev_dir_entry_t *dirIter = (fs_dev_dir_entry_t *)dirState->dirStruct;
 
-    OSLockMutex(dev->pMutex);
+    fs_dev_read_lock(&dev->lock);
 
-    char *real_path = fs_dev_real_path(path, dev);
-    if(!real_path) {
-        r->_errno = ENOMEM;
-        OSUnlockMutex(dev->pMutex);
-        return NULL;
-    }
+    const char *rel_path = fs_dev_rel_path(path);
 
     int dirHandle;
 
-    int result = IOSUHAX_FSA_OpenDir(dev->fsaFd, real_path, &dirHandle);
+    int fsaFd = fs_dev_get_fsa(dev);
 
-    free(real_path);
+    int result = iosuhax_fsa_open_dir(IOSUHAX_GetDefaultCtx(), fsaFd, dev->mount_path, rel_path, &dirHandle);
 
-    OSUnlockMutex(dev->pMutex);
+    fs_dev_read_unlock(&dev->lock);
 
     if(result < 0)
     {
@@ -716,7 +1448,12 @@ static DIR_ITER *fs_dev_diropen_r (struct _reent *r, DIR_ITER *dirState, const c
     }
 
     dirIter->dev = dev;
+    dirIter->fsaFd = fsaFd;
     dirIter->dirHandle = dirHandle;
+    dirIter->entry_idx = 0;
+    dirIter->entry_cnt = 0;
+    dirIter->end_result = 0;
+    OSInitMutex(dirIter->mutex);
 
     return dirState;
 }
@@ -729,11 +1466,11 @@ static int fs_dev_dirclose_r (struct _reent *r, DIR_ITER *dirState)
         return -1;
     }
 
-    OSLockMutex(dirIter->dev->pMutex);
+    OSLockMutex(dirIter->mutex);
 
-    int result = IOSUHAX_FSA_CloseDir(dirIter->dev->fsaFd, dirIter->dirHandle);
+    int result = IOSUHAX_FSA_CloseDir(dirIter->fsaFd, dirIter->dirHandle);
 
-    OSUnlockMutex(dirIter->dev->pMutex);
+    OSUnlockMutex(dirIter->mutex);
 
     if(result < 0)
     {
@@ -751,11 +1488,16 @@ static int fs_dev_dirreset_r (struct _reent *r, DIR_ITER *dirState)
         return -1;
     }
 
-    OSLockMutex(dirIter->dev->pMutex);
+    OSLockMutex(dirIter->mutex);
 
-    int result = IOSUHAX_FSA_RewindDir(dirIter->dev->fsaFd, dirIter->dirHandle);
+    int result = IOSUHAX_FSA_RewindDir(dirIter->fsaFd, dirIter->dirHandle);
 
-    OSUnlockMutex(dirIter->dev->pMutex);
+    // drop what was fetched ahead
+    dirIter->entry_idx = 0;
+    dirIter->entry_cnt = 0;
+    dirIter->end_result = 0;
+
+    OSUnlockMutex(dirIter->mutex);
 
     if(result < 0)
     {
@@ -773,19 +1515,29 @@ static int fs_dev_dirnext_r (struct _reent *r, DIR_ITER *dirState, char *filenam
         return -1;
     }
 
-    OSLockMutex(dirIter->dev->pMutex);
-
-    directoryEntry_s * dir_entry = malloc(sizeof(directoryEntry_s));
+    OSLockMutex(dirIter->mutex);
 
-    int result = IOSUHAX_FSA_ReadDir(dirIter->dev->fsaFd, dirIter->dirHandle, dir_entry);
-    if(result < 0)
+    // entries are fetched in batches and handed out one by one
+    if(dirIter->entry_idx >= dirIter->entry_cnt)
     {
-        free(dir_entry);
-        r->_errno = result;
-        OSUnlockMutex(dirIter->dev->pMutex);
-        return -1;
+        // a batch that ended early already got the final status, do not ask the resident again
+        int result = dirIter->end_result;
+        if(result == 0)
+            result = iosuhax_fsa_read_dir(IOSUHAX_GetDefaultCtx(), dirIter->fsaFd, dirIter->dirHandle, dirIter->entries, FS_DEV_DIR_BATCH, &dirIter->end_result);
+
+        if(result < 0 || (result == 0 && dirIter->end_result < 0))
+        {
+            r->_errno = (result < 0) ? result : dirIter->end_result;
+            OSUnlockMutex(dirIter->mutex);
+            return -1;
+        }
+
+        dirIter->entry_idx = 0;
+        dirIter->entry_cnt = result;
     }
 
+    directoryEntry_s *dir_entry = &dirIter->entries[dirIter->entry_idx++];
+
     // Fetch the current entry
     strcpy(filename, dir_entry->name);
 
@@ -805,8 +1557,7 @@ static int fs_dev_dirnext_r (struct _reent *r, DIR_ITER *dirState, char *filenam
         st->st_mtime = dir_entry->stat.mtime;
     }
 
-    free(dir_entry);
-    OSUnlockMutex(dirIter->dev->pMutex);
+    OSUnlockMutex(dirIter->mutex);
     return 0;
 }
 
@@ -839,7 +1590,14 @@ static const devoptab_t devops_fs = {
     NULL  /* Device data */
 };
 
-static int fs_dev_add_device (const char *name, const char *mount_path, int fsaFd, int isMounted)
+static void fs_dev_close_fsa_handles(fs_dev_private_t *priv)
+{
+    // the first handle belongs to the caller of mount_fs
+    while(priv->fsaCount > 1)
+        IOSUHAX_FSA_Close(priv->fsaFds[--priv->fsaCount]);
+}
+
+static int fs_dev_add_device (const char *name, const char *mount_path, int fsaFd, int isMounted, const mount_fs_options_t *options)
 {
     devoptab_t *dev = NULL;
     char *devname = NULL;
@@ -877,18 +1635,34 @@ static int fs_dev_add_device (const char *name, const char *mount_path, int fsaF
     // setup private data
     priv->mount_path = devpath;
     priv->fsaFd = fsaFd;
+    priv->fsaFds[0] = fsaFd;
+    priv->fsaCount = 1;
+    priv->fsaNext = 0;
     priv->mounted = isMounted;
-    priv->pMutex = malloc(OS_MUTEX_SIZE);
+    priv->file_cache_size = (options->file_cache_size + 0x3F) & ~0x3F;
+    priv->read_only = options->read_only;
+    fs_dev_rwlock_init(&priv->lock);
+
+    // without the cache memory the device simply runs uncached, read-only devices keep results forever
+    fs_dev_stat_cache_init(&priv->stat_cache, options->stat_cache_entries, options->read_only ? 0 : options->stat_cache_ttl_ms);
+    priv->name = devname;
+    priv->name_hash = fs_dev_hash_name(&priv->name, &priv->name_len);
+    priv->devoptab = dev;
+
+    // open the additional client handles, the device works with as many as could be opened
+    uint32_t fsaCount = options->fsa_handle_count;
+    if(fsaCount > FS_DEV_MAX_FSA_HANDLES)
+        fsaCount = FS_DEV_MAX_FSA_HANDLES;
+
+    while(priv->fsaCount < fsaCount)
+    {
+        int extraFd = IOSUHAX_FSA_Open();
+        if(extraFd < 0)
+            break;
 
-    if(!priv->pMutex) {
-        free(dev);
-        free(priv);
-        errno = ENOMEM;
-        return -1;
+        priv->fsaFds[priv->fsaCount++] = extraFd;
     }
 
-    OSInitMutex(priv->pMutex);
-
     // Setup the devoptab
     memcpy(dev, &devops_fs, sizeof(devoptab_t));
     dev->name = devname;
@@ -898,11 +1672,14 @@ static int fs_dev_add_device (const char *name, const char *mount_path, int fsaF
     for (i = 3; i < STD_MAX; i++) {
         if (devoptab_list[i] == devoptab_list[0]) {
             devoptab_list[i] = dev;
+            fs_dev_registry_add(priv);
             return 0;
         }
     }
 
     // failure, free all memory
+    fs_dev_close_fsa_handles(priv);
+    fs_dev_stat_cache_free(&priv->stat_cache);
     free(priv);
     free(dev);
 
@@ -913,47 +1690,53 @@ static int fs_dev_add_device (const char *name, const char *mount_path, int fsaF
 
 static int fs_dev_remove_device (const char *path)
 {
-    const devoptab_t *devoptab = NULL;
-    char name[128] = {0};
     int i;
 
-    // Get the device name from the path
-    strncpy(name, path, 127);
-    strtok(name, ":/");
+    fs_dev_private_t *priv = fs_dev_get_device_data(path);
+    if(!priv)
+        return -1;
 
-    // Find and remove the specified device from the devoptab table
-    // NOTE: We do this manually due to a 'bug' in RemoveDevice
-    //       which ignores names with suffixes and causes names
-    //       like "ntfs" and "ntfs1" to be seen as equals
+    fs_dev_registry_remove(priv);
+
+    // Remove the device from the devoptab table
     for (i = 3; i < STD_MAX; i++) {
-        devoptab = devoptab_list[i];
-        if (devoptab && devoptab->name) {
-            if (strcmp(name, devoptab->name) == 0) {
-                devoptab_list[i] = devoptab_list[0];
-
-                if(devoptab->deviceData)
-                {
-                    fs_dev_private_t *priv = (fs_dev_private_t *)devoptab->deviceData;
-
-                    if(priv->mounted)
-                        IOSUHAX_FSA_Unmount(priv->fsaFd, priv->mount_path, 2);
-
-                    if(priv->pMutex)
-                        free(priv->pMutex);
-                    free(devoptab->deviceData);
-                }
-
-                free((devoptab_t*)devoptab);
-                return 0;
-            }
+        if (devoptab_list[i] == priv->devoptab) {
+            devoptab_list[i] = devoptab_list[0];
+            break;
         }
     }
 
-    return -1;
+    if(priv->mounted)
+        IOSUHAX_FSA_Unmount(priv->fsaFd, priv->mount_path, 2);
+
+    fs_dev_close_fsa_handles(priv);
+    fs_dev_stat_cache_free(&priv->stat_cache);
+
+    free(priv->devoptab);
+    free(priv);
+    return 0;
+}
+
+void mount_fs_default_options(mount_fs_options_t *options)
+{
+    memset(options, 0, sizeof(mount_fs_options_t));
+    options->fsa_handle_count = 1;
 }
 
 int mount_fs(const char *virt_name, int fsaFd, const char *dev_path, const char *mount_path)
 {
+    return mount_fs_ex(virt_name, fsaFd, dev_path, mount_path, NULL);
+}
+
+int mount_fs_ex(const char *virt_name, int fsaFd, const char *dev_path, const char *mount_path, const mount_fs_options_t *options)
+{
+    mount_fs_options_t default_options;
+    if(!options)
+    {
+        mount_fs_default_options(&default_options);
+        options = &default_options;
+    }
+
     int isMounted = 0;
 
     if(dev_path)
@@ -967,7 +1750,7 @@ int mount_fs(const char *virt_name, int fsaFd, const char *dev_path, const char
         }
     }
 
-    return fs_dev_add_device(virt_name, mount_path, fsaFd, isMounted);
+    return fs_dev_add_device(virt_name, mount_path, fsaFd, isMounted, options);
 }
 
 int unmount_fs(const char *virt_name)
@@ -24,15 +24,29 @@
 #ifndef __IOSUHAX_DEVOPTAB_H_
 #define __IOSUHAX_DEVOPTAB_H_
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef struct _mount_fs_options_t
+{
+    uint32_t file_cache_size;       //! per open file read-ahead/write-back buffer in bytes (e.g. 0x8000), 0 disables the cache (default)
+    uint32_t fsa_handle_count;      //! FSA client handles used for the device, the extra ones are opened with IOSUHAX_FSA_Open (max 8)
+    uint32_t stat_cache_entries;    //! number of stat results kept per device, including "not found" results, 0 disables the cache
+    uint32_t stat_cache_ttl_ms;     //! lifetime of cached stat results in milliseconds, 0 keeps them until invalidated or evicted
+    int read_only;                  //! reject all modifications, cached stat results never expire
+} mount_fs_options_t;
+
 //! virtual name example:   sd or odd (for sd:/ or odd:/ access)
 //! fsaFd:                  fd received by IOSUHAX_FSA_Open();
 //! dev_path:               (optional) if a device should be mounted to the mount_path. If NULL no IOSUHAX_FSA_Mount is not executed.
 //! mount_path:             path to map to virtual device name
 int mount_fs(const char *virt_name, int fsaFd, const char *dev_path, const char *mount_path);
+//! same as mount_fs with tunable options, options may be NULL for the defaults
+int mount_fs_ex(const char *virt_name, int fsaFd, const char *dev_path, const char *mount_path, const mount_fs_options_t *options);
+void mount_fs_default_options(mount_fs_options_t *options);
 int unmount_fs(const char *virt_name);
 
 #ifdef __cplusplus
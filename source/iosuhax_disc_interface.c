@@ -23,150 +23,925 @@
  ***************************************************************************/
 #include <string.h>
 #include <malloc.h>
+#include "os_functions.h"
 #include "iosuhax.h"
 #include "iosuhax_disc_interface.h"
 
-#define FSA_REF_SD      0x01
-#define FSA_REF_USB     0x02
+//! used when the device does not report its sector size
+#define DISC_IO_SECTOR_SIZE         512
+//! IOSU does not report an optimal transfer unit, this is what the raw ioctls handle well
+#define DISC_IO_TRANSFER_SIZE       0x10000
+//! FSA query type of IOSUHAX_FSA_GetDeviceInfo() returning the device geometry
+#define FSA_DEVICE_INFO_GEOMETRY    4
+//! requests spanning this many cache pages go to the device directly
+#define DISC_IO_BYPASS_PAGES        4
+
+typedef struct _disc_io_page_t
+{
+    struct _disc_io_page_t *hash_next;
+    struct _disc_io_page_t *lru_prev;
+    struct _disc_io_page_t *lru_next;
+    uint32_t index;                     // page number, the first sector is index * page_sectors
+    int valid;
+    int dirty;
+    uint8_t *data;
+} disc_io_page_t;
+
+typedef struct _disc_io_device_t
+{
+    int fsaFd;
+    int rawFd;
+    const char *device_path;            // node held by rawFd, changed under nodeMutex
+    uint32_t sector_size;
+    uint64_t sector_count;              // 0 if unknown
+    uint32_t mutex[(OS_MUTEX_SIZE + 3) >> 2];
+
+    // sector cache
+    disc_io_page_t *pages;
+    disc_io_page_t **buckets;
+    uint8_t *page_data;
+    uint32_t page_count;
+    uint32_t page_sectors;
+    uint32_t bucket_mask;
+    int write_back;
+    disc_io_page_t *lru_head;           // most recently used
+    disc_io_page_t *lru_tail;
+
+    // write combining
+    uint8_t *wc_data;
+    uint32_t wc_max;                    // dirty limit in sectors, 0 if disabled
+    uint32_t wc_sector;
+    uint32_t wc_count;                  // sectors pending in wc_data
+
+    // sequential read-ahead
+    uint8_t *ra_data;
+    uint32_t ra_max;                    // buffer size in sectors, 0 if disabled
+    uint32_t ra_sector;
+    uint32_t ra_count;                  // sectors valid in ra_data
+    uint32_t ra_window;                 // sectors prefetched past the next request
+    uint32_t ra_next;                   // sector a sequential read would start at
+
+    discStats_s stats;
+} disc_io_device_t;
 
 static int initialized = 0;
+//! serializes taking and releasing nodes so two devices never hold the same one
+static uint32_t nodeMutex[(OS_MUTEX_SIZE + 3) >> 2];
+
+static disc_io_device_t sdioDevice;
+static disc_io_device_t usbDevice;
+static disc_io_device_t usbDevices[IOSUHAX_USB_MAX_DEVICES];
+static const DISC_INTERFACE IOSUHAX_usb_disc_interfaces[IOSUHAX_USB_MAX_DEVICES];
 
-static int fsaFdSd = 0;
-static int fsaFdUsb = 0;
-static int sdioFd = 0;
-static int usbFd = 0;
+static void IOSUHAX_disc_io_device_init(disc_io_device_t *dev)
+{
+    memset(dev, 0, sizeof(disc_io_device_t));
+    dev->fsaFd = -1;
+    dev->rawFd = -1;
+    dev->sector_size = DISC_IO_SECTOR_SIZE;
+    OSInitMutex(dev->mutex);
+}
 
 static void IOSUHAX_disc_io_initialize(void)
 {
     if(initialized == 0)
     {
         initialized = 1;
-        fsaFdSd = -1;
-        fsaFdUsb = -1;
-        sdioFd = -1;
-        usbFd = -1;
+        OSInitMutex(nodeMutex);
+        IOSUHAX_disc_io_device_init(&sdioDevice);
+        IOSUHAX_disc_io_device_init(&usbDevice);
+
+        int i;
+        for(i = 0; i < IOSUHAX_USB_MAX_DEVICES; i++)
+            IOSUHAX_disc_io_device_init(&usbDevices[i]);
     }
 }
 
-static bool IOSUHAX_disc_io_fsa_open(int fsaFd)
+static disc_io_device_t *IOSUHAX_disc_io_get_device(const DISC_INTERFACE *disc)
 {
     IOSUHAX_disc_io_initialize();
 
+    if(disc == &IOSUHAX_sdio_disc_interface)
+        return &sdioDevice;
+    if(disc == &IOSUHAX_usb_disc_interface)
+        return &usbDevice;
+    if(disc >= &IOSUHAX_usb_disc_interfaces[0] && disc < &IOSUHAX_usb_disc_interfaces[IOSUHAX_USB_MAX_DEVICES])
+        return &usbDevices[disc - &IOSUHAX_usb_disc_interfaces[0]];
+    return NULL;
+}
+
+static bool IOSUHAX_disc_io_fsa_open(disc_io_device_t *dev)
+{
     if(IOSUHAX_Open(NULL) < 0)
         return false;
 
-    if(fsaFd == FSA_REF_SD)
+    if(dev->fsaFd < 0)
+        dev->fsaFd = IOSUHAX_FSA_Open();
+
+    return (dev->fsaFd >= 0);
+}
+
+static void IOSUHAX_disc_io_fsa_close(disc_io_device_t *dev)
+{
+    if(dev->fsaFd >= 0)
     {
-        if(fsaFdSd < 0)
-        {
-            fsaFdSd = IOSUHAX_FSA_Open();
-        }
+        IOSUHAX_FSA_Close(dev->fsaFd);
+        dev->fsaFd = -1;
+    }
+}
+
+static bool IOSUHAX_disc_io_is_open(disc_io_device_t *dev)
+{
+    return initialized && (dev->fsaFd >= 0) && (dev->rawFd >= 0);
+}
+
+//! true if a device other than dev holds device_path, call with nodeMutex held
+static bool IOSUHAX_disc_io_node_in_use(const disc_io_device_t *dev, const char *device_path)
+{
+    if(dev != &usbDevice && usbDevice.device_path && strcmp(usbDevice.device_path, device_path) == 0)
+        return true;
 
-        if(fsaFdSd >= 0)
+    int i;
+    for(i = 0; i < IOSUHAX_USB_MAX_DEVICES; i++)
+    {
+        if(dev != &usbDevices[i] && usbDevices[i].device_path && strcmp(usbDevices[i].device_path, device_path) == 0)
             return true;
     }
-    else if(fsaFd == FSA_REF_USB)
+    return false;
+}
+
+static bool IOSUHAX_disc_io_raw_write(disc_io_device_t *dev, uint32_t sector, uint32_t numSectors, const void *buffer)
+{
+    dev->stats.device_writes++;
+    return IOSUHAX_FSA_RawWrite(dev->fsaFd, buffer, dev->sector_size, numSectors, sector, dev->rawFd) >= 0;
+}
+
+//! drop read-ahead data overlapping a write
+static void IOSUHAX_disc_ra_discard(disc_io_device_t *dev, uint32_t sector, uint32_t numSectors)
+{
+    if(dev->ra_count && (sector < dev->ra_sector + dev->ra_count) && (dev->ra_sector < sector + numSectors))
+        dev->ra_count = 0;
+}
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! write combining
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+static bool IOSUHAX_disc_wc_flush(disc_io_device_t *dev)
+{
+    if(dev->wc_count == 0)
+        return true;
+
+    bool result = IOSUHAX_disc_io_raw_write(dev, dev->wc_sector, dev->wc_count, dev->wc_data);
+    // a failed write is reported once, retrying it on every flush would not help
+    dev->wc_count = 0;
+    return result;
+}
+
+static bool IOSUHAX_disc_wc_overlaps(disc_io_device_t *dev, uint32_t sector, uint32_t numSectors)
+{
+    return dev->wc_count && (sector < dev->wc_sector + dev->wc_count) && (dev->wc_sector < sector + numSectors);
+}
+
+//! Writes that continue or overlap the pending range are merged into it as long as the result
+//! stays within the dirty limit, anything else flushes the pending range first.
+static bool IOSUHAX_disc_io_queue_write(disc_io_device_t *dev, uint32_t sector, uint32_t numSectors, const void *buffer)
+{
+    IOSUHAX_disc_ra_discard(dev, sector, numSectors);
+
+    if(dev->wc_max == 0)
+        return IOSUHAX_disc_io_raw_write(dev, sector, numSectors, buffer);
+
+    if(dev->wc_count && sector >= dev->wc_sector && sector <= dev->wc_sector + dev->wc_count
+       && sector + numSectors - dev->wc_sector <= dev->wc_max)
     {
-        if(fsaFdUsb < 0)
-        {
-            fsaFdUsb = IOSUHAX_FSA_Open();
-        }
+        memcpy(dev->wc_data + (sector - dev->wc_sector) * dev->sector_size, buffer, numSectors * dev->sector_size);
+        if(sector + numSectors > dev->wc_sector + dev->wc_count)
+            dev->wc_count = sector + numSectors - dev->wc_sector;
+        dev->stats.merged_writes++;
+        return true;
+    }
+
+    if(!IOSUHAX_disc_wc_flush(dev))
+        return false;
+
+    if(numSectors >= dev->wc_max)
+        return IOSUHAX_disc_io_raw_write(dev, sector, numSectors, buffer);
+
+    memcpy(dev->wc_data, buffer, numSectors * dev->sector_size);
+    dev->wc_sector = sector;
+    dev->wc_count = numSectors;
+    return true;
+}
+
+static bool IOSUHAX_disc_io_raw_read(disc_io_device_t *dev, uint32_t sector, uint32_t numSectors, void *buffer)
+{
+    // pending writes have to reach the device before it is read back
+    if(IOSUHAX_disc_wc_overlaps(dev, sector, numSectors) && !IOSUHAX_disc_wc_flush(dev))
+        return false;
+
+    dev->stats.device_reads++;
+    return IOSUHAX_FSA_RawRead(dev->fsaFd, buffer, dev->sector_size, numSectors, sector, dev->rawFd) >= 0;
+}
+
+static void IOSUHAX_disc_wc_free(disc_io_device_t *dev)
+{
+    free(dev->wc_data);
+    dev->wc_data = NULL;
+    dev->wc_max = 0;
+    dev->wc_count = 0;
+}
+
+static bool IOSUHAX_disc_wc_setup(disc_io_device_t *dev, uint32_t max_sectors)
+{
+    if(IOSUHAX_disc_io_is_open(dev) && !IOSUHAX_disc_wc_flush(dev))
+        return false;
+
+    IOSUHAX_disc_wc_free(dev);
+
+    if(max_sectors == 0)
+        return true;
+
+    dev->wc_data = (uint8_t*)memalign(0x40, max_sectors * dev->sector_size);
+    if(!dev->wc_data)
+        return false;
 
-        if(fsaFdUsb >= 0)
+    dev->wc_max = max_sectors;
+    return true;
+}
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! read-ahead
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! Reads continuing where the previous one ended double the prefetch window up to the buffer
+//! size, any other read that misses the buffer halves it until no prefetching is done.
+static bool IOSUHAX_disc_ra_read(disc_io_device_t *dev, uint32_t sector, uint32_t numSectors, void *buffer)
+{
+    if(dev->ra_max == 0)
+        return IOSUHAX_disc_io_raw_read(dev, sector, numSectors, buffer);
+
+    uint8_t *dst = (uint8_t*)buffer;
+
+    // serve what the buffer holds, the remainder continues right behind it
+    if(dev->ra_count && sector >= dev->ra_sector && sector < dev->ra_sector + dev->ra_count)
+    {
+        uint32_t count = dev->ra_sector + dev->ra_count - sector;
+        if(count > numSectors)
+            count = numSectors;
+
+        memcpy(dst, dev->ra_data + (sector - dev->ra_sector) * dev->sector_size, count * dev->sector_size);
+        dev->stats.readahead_hits++;
+
+        dst += count * dev->sector_size;
+        sector += count;
+        numSectors -= count;
+        dev->ra_next = sector;
+
+        if(numSectors == 0)
             return true;
     }
 
-    return false;
+    if(sector == dev->ra_next)
+    {
+        if(dev->ra_window == 0)
+            dev->ra_window = numSectors;
+        else if(dev->ra_window < dev->ra_max)
+            dev->ra_window <<= 1;
+
+        if(dev->ra_window > dev->ra_max)
+            dev->ra_window = dev->ra_max;
+    }
+    else
+    {
+        dev->ra_window >>= 1;
+    }
+
+    dev->ra_next = sector + numSectors;
+
+    if(dev->ra_window == 0 || numSectors >= dev->ra_max)
+        return IOSUHAX_disc_io_raw_read(dev, sector, numSectors, dst);
+
+    uint32_t fetch = numSectors + dev->ra_window;
+    if(fetch > dev->ra_max)
+        fetch = dev->ra_max;
+
+    dev->ra_count = 0;
+
+    if(!IOSUHAX_disc_io_raw_read(dev, sector, fetch, dev->ra_data))
+    {
+        // most likely reading past the end of the device
+        dev->ra_window = 0;
+        return IOSUHAX_disc_io_raw_read(dev, sector, numSectors, dst);
+    }
+
+    dev->ra_sector = sector;
+    dev->ra_count = fetch;
+    memcpy(dst, dev->ra_data, numSectors * dev->sector_size);
+    return true;
+}
+
+static void IOSUHAX_disc_ra_invalidate(disc_io_device_t *dev)
+{
+    dev->ra_count = 0;
+    dev->ra_window = 0;
+    dev->ra_next = 0;
+}
+
+static void IOSUHAX_disc_ra_free(disc_io_device_t *dev)
+{
+    free(dev->ra_data);
+    dev->ra_data = NULL;
+    dev->ra_max = 0;
+    IOSUHAX_disc_ra_invalidate(dev);
+}
+
+static bool IOSUHAX_disc_ra_setup(disc_io_device_t *dev, uint32_t max_sectors)
+{
+    IOSUHAX_disc_ra_free(dev);
+
+    if(max_sectors == 0)
+        return true;
+
+    dev->ra_data = (uint8_t*)memalign(0x40, max_sectors * dev->sector_size);
+    if(!dev->ra_data)
+        return false;
+
+    dev->ra_max = max_sectors;
+    return true;
+}
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! sector cache
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+static void IOSUHAX_disc_cache_lru_unlink(disc_io_device_t *dev, disc_io_page_t *page)
+{
+    if(page->lru_prev)
+        page->lru_prev->lru_next = page->lru_next;
+    else
+        dev->lru_head = page->lru_next;
+
+    if(page->lru_next)
+        page->lru_next->lru_prev = page->lru_prev;
+    else
+        dev->lru_tail = page->lru_prev;
+}
+
+static void IOSUHAX_disc_cache_lru_push_front(disc_io_device_t *dev, disc_io_page_t *page)
+{
+    page->lru_prev = NULL;
+    page->lru_next = dev->lru_head;
+    if(dev->lru_head)
+        dev->lru_head->lru_prev = page;
+    else
+        dev->lru_tail = page;
+    dev->lru_head = page;
+}
+
+static disc_io_page_t *IOSUHAX_disc_cache_find(disc_io_device_t *dev, uint32_t index)
+{
+    disc_io_page_t *page = dev->buckets[index & dev->bucket_mask];
+
+    while(page && page->index != index)
+        page = page->hash_next;
+
+    return page;
+}
+
+static void IOSUHAX_disc_cache_unhash(disc_io_device_t *dev, disc_io_page_t *page)
+{
+    disc_io_page_t **link = &dev->buckets[page->index & dev->bucket_mask];
+
+    while(*link != page)
+        link = &(*link)->hash_next;
+
+    *link = page->hash_next;
+    page->valid = 0;
+}
+
+static bool IOSUHAX_disc_cache_write_page(disc_io_device_t *dev, disc_io_page_t *page)
+{
+    if(!IOSUHAX_disc_io_queue_write(dev, page->index * dev->page_sectors, dev->page_sectors, page->data))
+        return false;
+
+    dev->stats.write_backs++;
+    page->dirty = 0;
+    return true;
 }
 
-static void IOSUHAX_disc_io_fsa_close(int fsaFd)
+//! Returns the page holding index. On a miss the least recently used page is reused, its data is
+//! only read from the device if load is set. NULL if the page could not be written back or loaded.
+static disc_io_page_t *IOSUHAX_disc_cache_get(disc_io_device_t *dev, uint32_t index, int load)
 {
-    if(fsaFd == FSA_REF_SD)
+    disc_io_page_t *page = IOSUHAX_disc_cache_find(dev, index);
+    if(page)
     {
-        if(fsaFdSd >= 0)
+        dev->stats.cache_hits++;
+    }
+    else
+    {
+        dev->stats.cache_misses++;
+
+        page = dev->lru_tail;
+        if(page->valid)
         {
-            IOSUHAX_FSA_Close(fsaFdSd);
-            fsaFdSd = -1;
+            if(page->dirty && !IOSUHAX_disc_cache_write_page(dev, page))
+                return NULL;
+
+            IOSUHAX_disc_cache_unhash(dev, page);
         }
+
+        if(load && !IOSUHAX_disc_ra_read(dev, index * dev->page_sectors, dev->page_sectors, page->data))
+            return NULL;
+
+        page->index = index;
+        page->valid = 1;
+        page->dirty = 0;
+
+        disc_io_page_t **bucket = &dev->buckets[index & dev->bucket_mask];
+        page->hash_next = *bucket;
+        *bucket = page;
     }
-    else if(fsaFd == FSA_REF_USB)
+
+    IOSUHAX_disc_cache_lru_unlink(dev, page);
+    IOSUHAX_disc_cache_lru_push_front(dev, page);
+    return page;
+}
+
+//! write back the dirty pages overlapping the sector range, all of them if numSectors is 0
+static bool IOSUHAX_disc_cache_flush_range(disc_io_device_t *dev, uint32_t sector, uint32_t numSectors)
+{
+    uint32_t i;
+    bool result = true;
+
+    for(i = 0; i < dev->page_count; i++)
     {
-        if(fsaFdUsb >= 0)
+        disc_io_page_t *page = &dev->pages[i];
+        if(!page->valid || !page->dirty)
+            continue;
+
+        if(numSectors)
         {
-            IOSUHAX_FSA_Close(fsaFdUsb);
-            fsaFdUsb = -1;
+            uint32_t first = page->index * dev->page_sectors;
+            if(first + dev->page_sectors <= sector || first >= sector + numSectors)
+                continue;
         }
+
+        if(!IOSUHAX_disc_cache_write_page(dev, page))
+            result = false;
     }
+
+    return result;
 }
 
-static bool IOSUHAX_sdio_startup(void)
+static void IOSUHAX_disc_cache_invalidate(disc_io_device_t *dev)
+{
+    uint32_t i;
+
+    if(dev->buckets)
+        memset(dev->buckets, 0, (dev->bucket_mask + 1) * sizeof(disc_io_page_t*));
+
+    for(i = 0; i < dev->page_count; i++)
+    {
+        dev->pages[i].valid = 0;
+        dev->pages[i].dirty = 0;
+    }
+}
+
+//! copy data written to the device into the cached pages it overlaps
+static void IOSUHAX_disc_cache_update(disc_io_device_t *dev, uint32_t sector, uint32_t numSectors, const uint8_t *src)
+{
+    while(numSectors)
+    {
+        uint32_t index = sector / dev->page_sectors;
+        uint32_t offset = sector - index * dev->page_sectors;
+        uint32_t count = dev->page_sectors - offset;
+        if(count > numSectors)
+            count = numSectors;
+
+        disc_io_page_t *page = IOSUHAX_disc_cache_find(dev, index);
+        if(page)
+            memcpy(page->data + offset * dev->sector_size, src, count * dev->sector_size);
+
+        src += count * dev->sector_size;
+        sector += count;
+        numSectors -= count;
+    }
+}
+
+static void IOSUHAX_disc_cache_free(disc_io_device_t *dev)
+{
+    free(dev->pages);
+    free(dev->buckets);
+    free(dev->page_data);
+    dev->pages = NULL;
+    dev->buckets = NULL;
+    dev->page_data = NULL;
+    dev->page_count = 0;
+    dev->lru_head = NULL;
+    dev->lru_tail = NULL;
+}
+
+static bool IOSUHAX_disc_cache_setup(disc_io_device_t *dev, uint32_t page_count, uint32_t page_sectors, bool write_back)
 {
-    if(!IOSUHAX_disc_io_fsa_open(FSA_REF_SD))
+    if(IOSUHAX_disc_io_is_open(dev) && !IOSUHAX_disc_cache_flush_range(dev, 0, 0))
         return false;
 
-    if(sdioFd < 0)
+    IOSUHAX_disc_cache_free(dev);
+
+    if(page_count == 0)
+        return true;
+
+    if(page_sectors == 0)
+        page_sectors = 1;
+
+    uint32_t bucket_cnt = 1;
+    while(bucket_cnt < page_count)
+        bucket_cnt <<= 1;
+
+    dev->pages = (disc_io_page_t*)malloc(page_count * sizeof(disc_io_page_t));
+    dev->buckets = (disc_io_page_t**)malloc(bucket_cnt * sizeof(disc_io_page_t*));
+    dev->page_data = (uint8_t*)memalign(0x40, page_count * page_sectors * dev->sector_size);
+    if(!dev->pages || !dev->buckets || !dev->page_data)
+    {
+        IOSUHAX_disc_cache_free(dev);
+        return false;
+    }
+
+    dev->page_count = page_count;
+    dev->page_sectors = page_sectors;
+    dev->bucket_mask = bucket_cnt - 1;
+    dev->write_back = write_back;
+
+    uint32_t i;
+    for(i = 0; i < page_count; i++)
     {
-        int res = IOSUHAX_FSA_RawOpen(fsaFdSd, "/dev/sdcard01", &sdioFd);
-        if(res < 0)
+        dev->pages[i].data = dev->page_data + i * page_sectors * dev->sector_size;
+        IOSUHAX_disc_cache_lru_push_front(dev, &dev->pages[i]);
+    }
+
+    IOSUHAX_disc_cache_invalidate(dev);
+    return true;
+}
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! generic device functions
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+static bool IOSUHAX_disc_io_read(disc_io_device_t *dev, uint32_t sector, uint32_t numSectors, void *buffer)
+{
+    if(!dev->pages || numSectors >= dev->page_sectors * DISC_IO_BYPASS_PAGES)
+    {
+        // written back data has to reach the device before it is read around the cache
+        if(dev->pages && !IOSUHAX_disc_cache_flush_range(dev, sector, numSectors))
+            return false;
+
+        return IOSUHAX_disc_ra_read(dev, sector, numSectors, buffer);
+    }
+
+    uint8_t *dst = (uint8_t*)buffer;
+
+    while(numSectors)
+    {
+        uint32_t index = sector / dev->page_sectors;
+        uint32_t offset = sector - index * dev->page_sectors;
+        uint32_t count = dev->page_sectors - offset;
+        if(count > numSectors)
+            count = numSectors;
+
+        disc_io_page_t *page = IOSUHAX_disc_cache_get(dev, index, 1);
+        if(page)
         {
-            IOSUHAX_disc_io_fsa_close(FSA_REF_SD);
-            sdioFd = -1;
+            memcpy(dst, page->data + offset * dev->sector_size, count * dev->sector_size);
         }
+        else if(!IOSUHAX_disc_ra_read(dev, sector, count, dst))
+        {
+            // e.g. a partial page at the end of the device
+            return false;
+        }
+
+        dst += count * dev->sector_size;
+        sector += count;
+        numSectors -= count;
     }
 
-    return (sdioFd >= 0);
+    return true;
 }
 
-static bool IOSUHAX_sdio_isInserted(void)
+static bool IOSUHAX_disc_io_write(disc_io_device_t *dev, uint32_t sector, uint32_t numSectors, const void *buffer)
 {
-    //! TODO: check for SD card inserted with IOSUHAX_FSA_GetDeviceInfo()
-    return initialized && (fsaFdSd >= 0) && (sdioFd >= 0);
+    if(!dev->pages)
+        return IOSUHAX_disc_io_queue_write(dev, sector, numSectors, buffer);
+
+    if(!dev->write_back || numSectors >= dev->page_sectors * DISC_IO_BYPASS_PAGES)
+    {
+        if(!IOSUHAX_disc_io_queue_write(dev, sector, numSectors, buffer))
+            return false;
+
+        IOSUHAX_disc_cache_update(dev, sector, numSectors, (const uint8_t*)buffer);
+        return true;
+    }
+
+    const uint8_t *src = (const uint8_t*)buffer;
+
+    while(numSectors)
+    {
+        uint32_t index = sector / dev->page_sectors;
+        uint32_t offset = sector - index * dev->page_sectors;
+        uint32_t count = dev->page_sectors - offset;
+        if(count > numSectors)
+            count = numSectors;
+
+        // fully overwritten pages do not need to be read first
+        int full_page = (offset == 0 && count == dev->page_sectors);
+
+        disc_io_page_t *page = IOSUHAX_disc_cache_get(dev, index, !full_page);
+        if(page)
+        {
+            memcpy(page->data + offset * dev->sector_size, src, count * dev->sector_size);
+            page->dirty = 1;
+        }
+        else if(!IOSUHAX_disc_io_queue_write(dev, sector, count, src))
+        {
+            return false;
+        }
+
+        src += count * dev->sector_size;
+        sector += count;
+        numSectors -= count;
+    }
+
+    return true;
 }
 
-static bool IOSUHAX_sdio_clearStatus(void)
+static bool IOSUHAX_disc_io_flush(disc_io_device_t *dev)
 {
-    return true;
+    bool result = true;
+
+    if(dev->pages)
+        result = IOSUHAX_disc_cache_flush_range(dev, 0, 0);
+
+    if(!IOSUHAX_disc_wc_flush(dev))
+        result = false;
+
+    return result;
 }
 
-static bool IOSUHAX_sdio_shutdown(void)
+//! Reads the sector size and count of the device. The buffers are sized in sectors so they are
+//! reallocated with the same settings if the sector size differs from the previous device.
+static void IOSUHAX_disc_io_query_geometry(disc_io_device_t *dev, const char *device_path)
 {
-    if(!IOSUHAX_sdio_isInserted())
-        return false;
+    uint32_t info[0x64 >> 2];
+    uint32_t sector_size = DISC_IO_SECTOR_SIZE;
 
-    IOSUHAX_FSA_RawClose(fsaFdSd, sdioFd);
-    IOSUHAX_disc_io_fsa_close(FSA_REF_SD);
-    sdioFd = -1;
-    return true;
+    dev->sector_count = 0;
+
+    if(IOSUHAX_FSA_GetDeviceInfo(dev->fsaFd, device_path, FSA_DEVICE_INFO_GEOMETRY, info) >= 0)
+    {
+        memcpy(&dev->sector_count, ((uint8_t*)info) + 0x08, sizeof(uint64_t));
+
+        // only accept sane power of two sizes
+        if(info[0x10 >> 2] >= DISC_IO_SECTOR_SIZE && info[0x10 >> 2] <= DISC_IO_TRANSFER_SIZE
+           && (info[0x10 >> 2] & (info[0x10 >> 2] - 1)) == 0)
+        {
+            sector_size = info[0x10 >> 2];
+        }
+    }
+
+    if(sector_size == dev->sector_size)
+        return;
+
+    dev->sector_size = sector_size;
+
+    if(dev->pages && !IOSUHAX_disc_cache_setup(dev, dev->page_count, dev->page_sectors, dev->write_back))
+        IOSUHAX_disc_cache_free(dev);
+    if(dev->wc_data)
+        IOSUHAX_disc_wc_setup(dev, dev->wc_max);
+    if(dev->ra_data)
+        IOSUHAX_disc_ra_setup(dev, dev->ra_max);
 }
 
-static bool IOSUHAX_sdio_readSectors(uint32_t sector, uint32_t numSectors, void* buffer)
+static bool IOSUHAX_disc_io_startup(disc_io_device_t *dev, const char * const *device_paths)
 {
-    if(!IOSUHAX_sdio_isInserted())
+    IOSUHAX_disc_io_initialize();
+
+    OSLockMutex(dev->mutex);
+
+    if(dev->rawFd < 0 && IOSUHAX_disc_io_fsa_open(dev))
+    {
+        OSLockMutex(nodeMutex);
+
+        for( ; *device_paths; device_paths++)
+        {
+            // the legacy USB interface and the per node ones may point at the same drive
+            if(IOSUHAX_disc_io_node_in_use(dev, *device_paths))
+                continue;
+
+            if(IOSUHAX_FSA_RawOpen(dev->fsaFd, *device_paths, &dev->rawFd) >= 0)
+            {
+                dev->device_path = *device_paths;
+                break;
+            }
+
+            dev->rawFd = -1;
+        }
+
+        OSUnlockMutex(nodeMutex);
+
+        if(dev->rawFd < 0)
+        {
+            IOSUHAX_disc_io_fsa_close(dev);
+        }
+        else
+        {
+            IOSUHAX_disc_cache_invalidate(dev);
+            IOSUHAX_disc_ra_invalidate(dev);
+            IOSUHAX_disc_io_query_geometry(dev, *device_paths);
+        }
+    }
+
+    bool result = (dev->rawFd >= 0);
+
+    OSUnlockMutex(dev->mutex);
+    return result;
+}
+
+static bool IOSUHAX_disc_io_shutdown(disc_io_device_t *dev)
+{
+    // the mutex only exists once initialized, the open state is checked under it
+    if(!initialized)
         return false;
 
-    int res = IOSUHAX_FSA_RawRead(fsaFdSd, buffer, 512, numSectors, sector, sdioFd);
-    if(res < 0)
+    OSLockMutex(dev->mutex);
+
+    if(!IOSUHAX_disc_io_is_open(dev))
     {
+        OSUnlockMutex(dev->mutex);
         return false;
     }
 
+    IOSUHAX_disc_io_flush(dev);
+    // the medium may change until the next startup
+    IOSUHAX_disc_cache_invalidate(dev);
+    IOSUHAX_disc_ra_invalidate(dev);
+
+    IOSUHAX_FSA_RawClose(dev->fsaFd, dev->rawFd);
+    IOSUHAX_disc_io_fsa_close(dev);
+    dev->rawFd = -1;
+
+    OSLockMutex(nodeMutex);
+    dev->device_path = NULL;
+    OSUnlockMutex(nodeMutex);
+
+    OSUnlockMutex(dev->mutex);
     return true;
 }
 
-static bool IOSUHAX_sdio_writeSectors(uint32_t sector, uint32_t numSectors, const void* buffer)
+static bool IOSUHAX_disc_io_read_sectors(disc_io_device_t *dev, uint32_t sector, uint32_t numSectors, void *buffer)
 {
-    if(!IOSUHAX_sdio_isInserted())
+    if(!initialized)
         return false;
 
-    int res = IOSUHAX_FSA_RawWrite(fsaFdSd, buffer, 512, numSectors, sector, sdioFd);
-    if(res < 0)
+    OSLockMutex(dev->mutex);
+    bool result = IOSUHAX_disc_io_is_open(dev) ? IOSUHAX_disc_io_read(dev, sector, numSectors, buffer) : false;
+    OSUnlockMutex(dev->mutex);
+    return result;
+}
+
+static bool IOSUHAX_disc_io_write_sectors(disc_io_device_t *dev, uint32_t sector, uint32_t numSectors, const void *buffer)
+{
+    if(!initialized)
+        return false;
+
+    OSLockMutex(dev->mutex);
+    bool result = IOSUHAX_disc_io_is_open(dev) ? IOSUHAX_disc_io_write(dev, sector, numSectors, buffer) : false;
+    OSUnlockMutex(dev->mutex);
+    return result;
+}
+
+static bool IOSUHAX_disc_io_clear_status(disc_io_device_t *dev)
+{
+    if(!initialized)
+        return true;
+
+    OSLockMutex(dev->mutex);
+    bool result = IOSUHAX_disc_io_is_open(dev) ? IOSUHAX_disc_io_flush(dev) : true;
+    OSUnlockMutex(dev->mutex);
+    return result;
+}
+
+bool IOSUHAX_disc_set_cache(const DISC_INTERFACE *disc, uint32_t page_count, uint32_t page_sectors, bool write_back)
+{
+    disc_io_device_t *dev = IOSUHAX_disc_io_get_device(disc);
+    if(!dev)
+        return false;
+
+    OSLockMutex(dev->mutex);
+    bool result = IOSUHAX_disc_cache_setup(dev, page_count, page_sectors, write_back);
+    OSUnlockMutex(dev->mutex);
+    return result;
+}
+
+bool IOSUHAX_disc_set_write_combining(const DISC_INTERFACE *disc, uint32_t max_sectors)
+{
+    disc_io_device_t *dev = IOSUHAX_disc_io_get_device(disc);
+    if(!dev)
+        return false;
+
+    OSLockMutex(dev->mutex);
+    bool result = IOSUHAX_disc_wc_setup(dev, max_sectors);
+    OSUnlockMutex(dev->mutex);
+    return result;
+}
+
+bool IOSUHAX_disc_set_read_ahead(const DISC_INTERFACE *disc, uint32_t max_sectors)
+{
+    disc_io_device_t *dev = IOSUHAX_disc_io_get_device(disc);
+    if(!dev)
+        return false;
+
+    OSLockMutex(dev->mutex);
+    bool result = IOSUHAX_disc_ra_setup(dev, max_sectors);
+    OSUnlockMutex(dev->mutex);
+    return result;
+}
+
+bool IOSUHAX_disc_get_geometry(const DISC_INTERFACE *disc, discGeometry_s *geometry)
+{
+    disc_io_device_t *dev = IOSUHAX_disc_io_get_device(disc);
+    if(!dev)
+        return false;
+
+    OSLockMutex(dev->mutex);
+    if(!IOSUHAX_disc_io_is_open(dev))
     {
+        OSUnlockMutex(dev->mutex);
         return false;
     }
 
+    geometry->sector_size = dev->sector_size;
+    geometry->sector_count = dev->sector_count;
+    geometry->transfer_size = (dev->sector_size > DISC_IO_TRANSFER_SIZE) ? dev->sector_size : DISC_IO_TRANSFER_SIZE;
+    OSUnlockMutex(dev->mutex);
+    return true;
+}
+
+bool IOSUHAX_disc_get_stats(const DISC_INTERFACE *disc, discStats_s *stats)
+{
+    disc_io_device_t *dev = IOSUHAX_disc_io_get_device(disc);
+    if(!dev)
+        return false;
+
+    OSLockMutex(dev->mutex);
+    memcpy(stats, &dev->stats, sizeof(discStats_s));
+    OSUnlockMutex(dev->mutex);
     return true;
 }
 
+void IOSUHAX_disc_reset_stats(const DISC_INTERFACE *disc)
+{
+    disc_io_device_t *dev = IOSUHAX_disc_io_get_device(disc);
+    if(!dev)
+        return;
+
+    OSLockMutex(dev->mutex);
+    memset(&dev->stats, 0, sizeof(discStats_s));
+    OSUnlockMutex(dev->mutex);
+}
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! SD card
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+static const char * const sdioDevicePaths[] = { "/dev/sdcard01", NULL };
+
+static bool IOSUHAX_sdio_startup(void)
+{
+    return IOSUHAX_disc_io_startup(&sdioDevice, sdioDevicePaths);
+}
+
+static bool IOSUHAX_sdio_isInserted(void)
+{
+    //! TODO: check for SD card inserted with IOSUHAX_FSA_GetDeviceInfo()
+    return IOSUHAX_disc_io_is_open(&sdioDevice);
+}
+
+static bool IOSUHAX_sdio_clearStatus(void)
+{
+    return IOSUHAX_disc_io_clear_status(&sdioDevice);
+}
+
+static bool IOSUHAX_sdio_shutdown(void)
+{
+    return IOSUHAX_disc_io_shutdown(&sdioDevice);
+}
+
+static bool IOSUHAX_sdio_readSectors(uint32_t sector, uint32_t numSectors, void* buffer)
+{
+    return IOSUHAX_disc_io_read_sectors(&sdioDevice, sector, numSectors, buffer);
+}
+
+static bool IOSUHAX_sdio_writeSectors(uint32_t sector, uint32_t numSectors, const void* buffer)
+{
+    return IOSUHAX_disc_io_write_sectors(&sdioDevice, sector, numSectors, buffer);
+}
+
 const DISC_INTERFACE IOSUHAX_sdio_disc_interface =
 {
 	DEVICE_TYPE_WII_U_SD,
@@ -179,74 +954,39 @@ const DISC_INTERFACE IOSUHAX_sdio_disc_interface =
     IOSUHAX_sdio_shutdown
 };
 
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! USB
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+static const char * const usbDevicePaths[] = { "/dev/usb01", "/dev/usb02", NULL };
+
 static bool IOSUHAX_usb_startup(void)
 {
-    if(!IOSUHAX_disc_io_fsa_open(FSA_REF_USB))
-        return false;
-
-    if(usbFd < 0)
-    {
-        int res = IOSUHAX_FSA_RawOpen(fsaFdUsb, "/dev/usb01", &usbFd);
-        if(res < 0)
-        {
-            res = IOSUHAX_FSA_RawOpen(fsaFdUsb, "/dev/usb02", &usbFd);
-            if(res < 0)
-            {
-                IOSUHAX_disc_io_fsa_close(FSA_REF_USB);
-                usbFd = -1;
-            }
-        }
-    }
-    return (usbFd >= 0);
+    return IOSUHAX_disc_io_startup(&usbDevice, usbDevicePaths);
 }
 
 static bool IOSUHAX_usb_isInserted(void)
 {
-    return initialized && (fsaFdUsb >= 0) && (usbFd >= 0);
+    return IOSUHAX_disc_io_is_open(&usbDevice);
 }
 
 static bool IOSUHAX_usb_clearStatus(void)
 {
-    return true;
+    return IOSUHAX_disc_io_clear_status(&usbDevice);
 }
 
 static bool IOSUHAX_usb_shutdown(void)
 {
-    if(!IOSUHAX_usb_isInserted())
-        return false;
-
-    IOSUHAX_FSA_RawClose(fsaFdUsb, usbFd);
-    IOSUHAX_disc_io_fsa_close(FSA_REF_USB);
-    usbFd = -1;
-    return true;
+    return IOSUHAX_disc_io_shutdown(&usbDevice);
 }
 
 static bool IOSUHAX_usb_readSectors(uint32_t sector, uint32_t numSectors, void* buffer)
 {
-    if(!IOSUHAX_usb_isInserted())
-        return false;
-
-    int res = IOSUHAX_FSA_RawRead(fsaFdUsb, buffer, 512, numSectors, sector, usbFd);
-    if(res < 0)
-    {
-        return false;
-    }
-
-    return true;
+    return IOSUHAX_disc_io_read_sectors(&usbDevice, sector, numSectors, buffer);
 }
 
 static bool IOSUHAX_usb_writeSectors(uint32_t sector, uint32_t numSectors, const void* buffer)
 {
-    if(!IOSUHAX_usb_isInserted())
-        return false;
-
-    int res = IOSUHAX_FSA_RawWrite(fsaFdUsb, buffer, 512, numSectors, sector, usbFd);
-    if(res < 0)
-    {
-        return false;
-    }
-
-    return true;
+    return IOSUHAX_disc_io_write_sectors(&usbDevice, sector, numSectors, buffer);
 }
 
 const DISC_INTERFACE IOSUHAX_usb_disc_interface =
@@ -260,3 +1000,97 @@ const DISC_INTERFACE IOSUHAX_usb_disc_interface =
     IOSUHAX_usb_clearStatus,
     IOSUHAX_usb_shutdown
 };
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! USB devices by node, the callbacks carry no context so every node gets its own set
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+#define IOSUHAX_USB_NODE(idx, nn) \
+static const char * const usbDevicePaths##nn[] = { "/dev/usb" #nn, NULL }; \
+static bool IOSUHAX_usb##nn##_startup(void) { return IOSUHAX_disc_io_startup(&usbDevices[idx], usbDevicePaths##nn); } \
+static bool IOSUHAX_usb##nn##_isInserted(void) { return IOSUHAX_disc_io_is_open(&usbDevices[idx]); } \
+static bool IOSUHAX_usb##nn##_clearStatus(void) { return IOSUHAX_disc_io_clear_status(&usbDevices[idx]); } \
+static bool IOSUHAX_usb##nn##_shutdown(void) { return IOSUHAX_disc_io_shutdown(&usbDevices[idx]); } \
+static bool IOSUHAX_usb##nn##_readSectors(uint32_t sector, uint32_t numSectors, void* buffer) \
+    { return IOSUHAX_disc_io_read_sectors(&usbDevices[idx], sector, numSectors, buffer); } \
+static bool IOSUHAX_usb##nn##_writeSectors(uint32_t sector, uint32_t numSectors, const void* buffer) \
+    { return IOSUHAX_disc_io_write_sectors(&usbDevices[idx], sector, numSectors, buffer); }
+
+#define IOSUHAX_USB_NODE_INTERFACE(nn) \
+{ \
+    DEVICE_TYPE_WII_U_USB, \
+    FEATURE_MEDIUM_CANREAD | FEATURE_MEDIUM_CANWRITE | FEATURE_WII_U_USB, \
+    IOSUHAX_usb##nn##_startup, \
+    IOSUHAX_usb##nn##_isInserted, \
+    IOSUHAX_usb##nn##_readSectors, \
+    IOSUHAX_usb##nn##_writeSectors, \
+    IOSUHAX_usb##nn##_clearStatus, \
+    IOSUHAX_usb##nn##_shutdown \
+}
+
+IOSUHAX_USB_NODE(0, 01)
+IOSUHAX_USB_NODE(1, 02)
+IOSUHAX_USB_NODE(2, 03)
+IOSUHAX_USB_NODE(3, 04)
+IOSUHAX_USB_NODE(4, 05)
+IOSUHAX_USB_NODE(5, 06)
+IOSUHAX_USB_NODE(6, 07)
+IOSUHAX_USB_NODE(7, 08)
+
+static const DISC_INTERFACE IOSUHAX_usb_disc_interfaces[IOSUHAX_USB_MAX_DEVICES] =
+{
+    IOSUHAX_USB_NODE_INTERFACE(01),
+    IOSUHAX_USB_NODE_INTERFACE(02),
+    IOSUHAX_USB_NODE_INTERFACE(03),
+    IOSUHAX_USB_NODE_INTERFACE(04),
+    IOSUHAX_USB_NODE_INTERFACE(05),
+    IOSUHAX_USB_NODE_INTERFACE(06),
+    IOSUHAX_USB_NODE_INTERFACE(07),
+    IOSUHAX_USB_NODE_INTERFACE(08)
+};
+
+static const char * const * const usbNodePaths[IOSUHAX_USB_MAX_DEVICES] =
+{
+    usbDevicePaths01, usbDevicePaths02, usbDevicePaths03, usbDevicePaths04,
+    usbDevicePaths05, usbDevicePaths06, usbDevicePaths07, usbDevicePaths08
+};
+
+int IOSUHAX_usb_get_disc_interfaces(const DISC_INTERFACE **interfaces, int max_count)
+{
+    IOSUHAX_disc_io_initialize();
+
+    if(IOSUHAX_Open(NULL) < 0)
+        return -1;
+
+    int fsaFd = IOSUHAX_FSA_Open();
+    if(fsaFd < 0)
+        return fsaFd;
+
+    int i;
+    int count = 0;
+
+    OSLockMutex(nodeMutex);
+
+    for(i = 0; i < IOSUHAX_USB_MAX_DEVICES && count < max_count; i++)
+    {
+        // started instances keep their raw handle open, others are probed
+        if(!usbDevices[i].device_path)
+        {
+            // held by IOSUHAX_usb_disc_interface
+            if(IOSUHAX_disc_io_node_in_use(&usbDevices[i], usbNodePaths[i][0]))
+                continue;
+
+            int rawFd = -1;
+            if(IOSUHAX_FSA_RawOpen(fsaFd, usbNodePaths[i][0], &rawFd) < 0)
+                continue;
+
+            IOSUHAX_FSA_RawClose(fsaFd, rawFd);
+        }
+
+        interfaces[count++] = &IOSUHAX_usb_disc_interfaces[i];
+    }
+
+    OSUnlockMutex(nodeMutex);
+
+    IOSUHAX_FSA_Close(fsaFd);
+    return count;
+}
@@ -66,6 +66,49 @@ typedef struct DISC_INTERFACE_STRUCT DISC_INTERFACE ;
 extern const DISC_INTERFACE IOSUHAX_sdio_disc_interface;
 extern const DISC_INTERFACE IOSUHAX_usb_disc_interface;
 
+#define IOSUHAX_USB_MAX_DEVICES     8
+
+//! Fills interfaces with one interface per available /dev/usbNN node and returns their count, or a
+//! negative error. Every interface has its own FSA handle, lock and buffers so different drives can
+//! be used in parallel. A node IOSUHAX_usb_disc_interface has started on is left out, and it skips
+//! nodes one of these interfaces holds.
+int IOSUHAX_usb_get_disc_interfaces(const DISC_INTERFACE **interfaces, int max_count);
+
+typedef struct _discGeometry_s
+{
+    uint32_t sector_size;       //! native sector size in bytes, the unit of all sector arguments
+    uint64_t sector_count;      //! number of sectors, 0 if the device did not report it
+    uint32_t transfer_size;     //! preferred transfer size in bytes, a multiple of sector_size
+} discGeometry_s;
+
+typedef struct _discStats_s
+{
+    uint32_t cache_hits;        //! cache page lookups that found the page
+    uint32_t cache_misses;      //! cache page lookups that had to allocate a page
+    uint32_t write_backs;       //! dirty pages written back to the device
+    uint32_t device_reads;      //! raw read requests sent to IOSU
+    uint32_t device_writes;     //! raw write requests sent to IOSU
+    uint32_t merged_writes;     //! writes merged into a pending combined write
+    uint32_t readahead_hits;    //! reads served at least partly from the read-ahead buffer
+} discStats_s;
+
+//! Optional sector cache of page_count pages of page_sectors sectors each, replaced in LRU order.
+//! With write_back writes stay in the cache until their page is evicted or clearStatus/shutdown
+//! flush it, else they go to the device right away. page_count 0 disables the cache (default).
+bool IOSUHAX_disc_set_cache(const DISC_INTERFACE *disc, uint32_t page_count, uint32_t page_sectors, bool write_back);
+//! Merge adjacent or overlapping sector writes into one raw write of up to max_sectors sectors.
+//! Pending data is written on clearStatus/shutdown, before reads overlapping it and once the next
+//! write does not fit. max_sectors 0 disables combining (default).
+bool IOSUHAX_disc_set_write_combining(const DISC_INTERFACE *disc, uint32_t max_sectors);
+//! Prefetch sectors following sequential reads into a buffer of max_sectors sectors. The prefetch
+//! window grows while reads stay sequential and shrinks on random access. max_sectors 0 disables
+//! read-ahead (default).
+bool IOSUHAX_disc_set_read_ahead(const DISC_INTERFACE *disc, uint32_t max_sectors);
+//! Geometry of the device queried on startup, false if the interface is not started.
+bool IOSUHAX_disc_get_geometry(const DISC_INTERFACE *disc, discGeometry_s *geometry);
+bool IOSUHAX_disc_get_stats(const DISC_INTERFACE *disc, discStats_s *stats);
+void IOSUHAX_disc_reset_stats(const DISC_INTERFACE *disc);
+
 #ifdef __cplusplus
 }
 #endif
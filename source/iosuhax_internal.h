@@ -0,0 +1,113 @@
+/***************************************************************************
+ * Copyright (C) 2016
+ * by Dimok
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any
+ * damages arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any
+ * purpose, including commercial applications, and to alter it and
+ * redistribute it freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you
+ * must not claim that you wrote the original software. If you use
+ * this software in a product, an acknowledgment in the product
+ * documentation would be appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and
+ * must not be misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source
+ * distribution.
+ ***************************************************************************/
+#ifndef _IOSUHAX_INTERNAL_H_
+#define _IOSUHAX_INTERNAL_H_
+
+#include "iosuhax.h"
+#include "iosuhax_pool.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IOSUHAX_MAGIC_WORD          0x4E696365
+
+#define IOCTL_MEM_WRITE             0x00
+#define IOCTL_MEM_READ              0x01
+#define IOCTL_SVC                   0x02
+#define IOCTL_MEMCPY                0x04
+#define IOCTL_REPEATED_WRITE        0x05
+#define IOCTL_KERN_READ32           0x06
+#define IOCTL_KERN_WRITE32          0x07
+
+#define IOCTL_FSA_OPEN              0x40
+#define IOCTL_FSA_CLOSE             0x41
+#define IOCTL_FSA_MOUNT             0x42
+#define IOCTL_FSA_UNMOUNT           0x43
+#define IOCTL_FSA_GETDEVICEINFO     0x44
+#define IOCTL_FSA_OPENDIR           0x45
+#define IOCTL_FSA_READDIR           0x46
+#define IOCTL_FSA_CLOSEDIR          0x47
+#define IOCTL_FSA_MAKEDIR           0x48
+#define IOCTL_FSA_OPENFILE          0x49
+#define IOCTL_FSA_READFILE          0x4A
+#define IOCTL_FSA_WRITEFILE         0x4B
+#define IOCTL_FSA_STATFILE          0x4C
+#define IOCTL_FSA_CLOSEFILE         0x4D
+#define IOCTL_FSA_SETFILEPOS        0x4E
+#define IOCTL_FSA_GETSTAT           0x4F
+#define IOCTL_FSA_REMOVE            0x50
+#define IOCTL_FSA_REWINDDIR         0x51
+#define IOCTL_FSA_CHDIR             0x52
+#define IOCTL_FSA_RENAME            0x53
+#define IOCTL_FSA_RAW_OPEN          0x54
+#define IOCTL_FSA_RAW_READ          0x55
+#define IOCTL_FSA_RAW_WRITE         0x56
+#define IOCTL_FSA_RAW_CLOSE         0x57
+#define IOCTL_FSA_CHANGEMODE        0x58
+#define IOCTL_FSA_FLUSHVOLUME       0x59
+#define IOCTL_CHECK_IF_IOSUHAX      0x5B
+
+//! FSA status codes the library reacts to
+#define FSA_STATUS_END_OF_DIR       (-0x30004)
+#define FSA_STATUS_END_OF_FILE      (-0x30005)
+#define FSA_STATUS_ALREADY_EXISTS   (-0x30016)
+#define FSA_STATUS_NOT_FOUND        (-0x30017)
+#define FSA_STATUS_STORAGE_FULL     (-0x3001C)
+
+#define ALIGN(align)       __attribute__((aligned(align)))
+#define ROUNDUP(x, align)  (((x) + ((align) - 1)) & ~((align) - 1))
+
+#define IOSUHAX_CTX_MAX_FSA_HANDLES 16
+
+struct _iosuhax_ctx_t
+{
+    int handle;                 // IOS handle of /dev/iosuhax
+    iosuhax_pool_t pool;        // ioctl marshalling buffers
+    int fsa_handles[IOSUHAX_CTX_MAX_FSA_HANDLES];
+    uint32_t fsa_cnt;
+    int initialized;
+    uint32_t mutex[(OS_MUTEX_SIZE + 3) >> 2];
+};
+
+#define IOSUHAX_CTX_INITIALIZER     { -1, IOSUHAX_POOL_INITIALIZER, { 0 }, 0, 0, { 0 } }
+
+//! FSA path calls with the path split into a prefix (e.g. a mount path) and the rest, both are
+//! written straight into the ioctl buffer so callers translating paths need no temporary string
+int iosuhax_fsa_get_device_info(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char* device_path, int type, uint32_t* out_data);
+int iosuhax_fsa_make_dir(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char* path, uint32_t flags);
+int iosuhax_fsa_open_dir(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char* path, int* outHandle);
+int iosuhax_fsa_read_dir(iosuhax_ctx_t *ctx, int fsaFd, int handle, directoryEntry_s* out_data, uint32_t max_entries, int *last_result);
+int iosuhax_fsa_change_dir(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char *path);
+int iosuhax_fsa_open_file(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char* path, const char* mode, int* outHandle);
+int iosuhax_fsa_get_stat(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char *path, fileStat_s* out_data);
+int iosuhax_fsa_remove(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char *path);
+int iosuhax_fsa_rename(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char *old_path, const char *new_path);
+int iosuhax_fsa_change_mode(iosuhax_ctx_t *ctx, int fsaFd, const char *prefix, const char* path, int mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,184 @@
+/***************************************************************************
+ * Copyright (C) 2016
+ * by Dimok
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any
+ * damages arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any
+ * purpose, including commercial applications, and to alter it and
+ * redistribute it freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you
+ * must not claim that you wrote the original software. If you use
+ * this software in a product, an acknowledgment in the product
+ * documentation would be appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and
+ * must not be misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source
+ * distribution.
+ ***************************************************************************/
+#include <string.h>
+#include <malloc.h>
+#include "iosuhax_internal.h"
+
+//! largest class fits a default transfer chunk plus the 0x40 byte ioctl header
+static const uint32_t pool_class_size[IOSUHAX_POOL_CLASS_CNT] =
+{
+    0x40, 0x100, 0x400, 0x1000, 0x8000, 0x20040
+};
+
+static int iosuhax_pool_class(uint32_t size)
+{
+    int i;
+    for(i = 0; i < IOSUHAX_POOL_CLASS_CNT; i++)
+    {
+        if(size <= pool_class_size[i])
+            return i;
+    }
+    return -1;
+}
+
+static uint32_t iosuhax_pool_block_size(uint32_t size)
+{
+    int idx = iosuhax_pool_class(size);
+    if(idx < 0)
+        return ROUNDUP(size, IOSUHAX_POOL_ALIGN);
+
+    return pool_class_size[idx];
+}
+
+#define POOL_HEAD_PTR(head)         ((void*)(uintptr_t)(uint32_t)(head))
+#define POOL_HEAD_MAKE(head, ptr)   ((((head) >> 32) + 1) << 32 | (uint32_t)(uintptr_t)(ptr))
+
+static void iosuhax_pool_push(iosuhax_pool_t *pool, int idx, void *buffer)
+{
+    unsigned long long head;
+
+    do
+    {
+        head = pool->free_list[idx];
+        *(uint32_t*)buffer = (uint32_t)head;
+    }
+    while(!OSCompareAndSwapAtomic64(&pool->free_list[idx], head, POOL_HEAD_MAKE(head, buffer)));
+}
+
+//! A popped block may be handed out or freed while another thread still reads its link word,
+//! that read only ever feeds a compare and swap which fails because the counter moved on.
+static void *iosuhax_pool_pop(iosuhax_pool_t *pool, int idx)
+{
+    unsigned long long head;
+    void *buffer;
+
+    do
+    {
+        head = pool->free_list[idx];
+        buffer = POOL_HEAD_PTR(head);
+        if(!buffer)
+            return NULL;
+    }
+    while(!OSCompareAndSwapAtomic64(&pool->free_list[idx], head, POOL_HEAD_MAKE(head, (uintptr_t)*(uint32_t*)buffer)));
+
+    return buffer;
+}
+
+void iosuhax_pool_init(iosuhax_pool_t *pool)
+{
+    pool->initialized = 1;
+}
+
+//! frees cached blocks, largest class first, until at most keep_bytes are cached
+static void iosuhax_pool_trim(iosuhax_pool_t *pool, uint32_t keep_bytes)
+{
+    int i;
+
+    for(i = IOSUHAX_POOL_CLASS_CNT - 1; i >= 0 && pool->cached_bytes > keep_bytes; i--)
+    {
+        while(pool->cached_bytes > keep_bytes)
+        {
+            void *buffer = iosuhax_pool_pop(pool, i);
+            if(!buffer)
+                break;
+
+            OSAddAtomic(&pool->cached_bytes, -(int)pool_class_size[i]);
+            free(buffer);
+        }
+    }
+}
+
+void iosuhax_pool_drain(iosuhax_pool_t *pool)
+{
+    if(!pool->initialized)
+        return;
+
+    iosuhax_pool_trim(pool, 0);
+}
+
+void iosuhax_pool_set_limit(iosuhax_pool_t *pool, uint32_t limit)
+{
+    pool->limit = limit;
+
+    if(pool->initialized)
+        iosuhax_pool_trim(pool, limit);
+}
+
+void *iosuhax_pool_alloc(iosuhax_pool_t *pool, uint32_t size)
+{
+    int idx = iosuhax_pool_class(size);
+    uint32_t block_size = iosuhax_pool_block_size(size);
+
+    if(!pool->initialized)
+        return memalign(IOSUHAX_POOL_ALIGN, block_size);
+
+    void *buffer = (idx >= 0) ? iosuhax_pool_pop(pool, idx) : NULL;
+    if(buffer)
+    {
+        OSAddAtomic(&pool->cached_bytes, -(int)block_size);
+        OSAddAtomic(&pool->used_bytes, block_size);
+        return buffer;
+    }
+
+    buffer = memalign(IOSUHAX_POOL_ALIGN, block_size);
+    if(!buffer)
+        return NULL;
+
+    uint32_t total = OSAddAtomic(&pool->used_bytes, block_size) + block_size + pool->cached_bytes;
+    if(total > pool->high_water)
+        pool->high_water = total;
+
+    return buffer;
+}
+
+void iosuhax_pool_free(iosuhax_pool_t *pool, void *buffer, uint32_t size)
+{
+    if(!buffer)
+        return;
+
+    if(!pool->initialized)
+    {
+        free(buffer);
+        return;
+    }
+
+    int idx = iosuhax_pool_class(size);
+    uint32_t block_size = iosuhax_pool_block_size(size);
+
+    OSAddAtomic(&pool->used_bytes, -(int)block_size);
+
+    if(idx >= 0)
+    {
+        //! reserve the space first so concurrent frees can not overshoot the limit together
+        if(OSAddAtomic(&pool->cached_bytes, block_size) + block_size <= pool->limit)
+        {
+            iosuhax_pool_push(pool, idx, buffer);
+            return;
+        }
+
+        OSAddAtomic(&pool->cached_bytes, -(int)block_size);
+    }
+
+    free(buffer);
+}
@@ -0,0 +1,68 @@
+/***************************************************************************
+ * Copyright (C) 2016
+ * by Dimok
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any
+ * damages arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any
+ * purpose, including commercial applications, and to alter it and
+ * redistribute it freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you
+ * must not claim that you wrote the original software. If you use
+ * this software in a product, an acknowledgment in the product
+ * documentation would be appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and
+ * must not be misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source
+ * distribution.
+ ***************************************************************************/
+#ifndef _IOSUHAX_POOL_H_
+#define _IOSUHAX_POOL_H_
+
+#include <stdint.h>
+#include "os_functions.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! all pool buffers are aligned to and sized in multiples of a cache line
+#define IOSUHAX_POOL_ALIGN          0x40
+#define IOSUHAX_POOL_CLASS_CNT      6
+//! keeps two largest class blocks for double buffered transfers plus the small classes
+#define IOSUHAX_POOL_DEFAULT_LIMIT  0x60000
+
+//! The free lists are lock-free LIFOs so threads sharing a context do not serialize on the pool.
+//! Each list head packs a change counter (high word) with the block address (low word) so a
+//! compare and swap fails if the head was popped and pushed again in between (ABA).
+typedef struct _iosuhax_pool_t
+{
+    volatile unsigned long long free_list[IOSUHAX_POOL_CLASS_CNT];
+    volatile unsigned int cached_bytes; // bytes sitting in the free lists
+    volatile unsigned int used_bytes;   // bytes handed out and not yet returned
+    uint32_t high_water;                // peak of cached_bytes + used_bytes, statistics only
+    uint32_t limit;                     // max bytes kept in the free lists
+    int initialized;
+} iosuhax_pool_t;
+
+#define IOSUHAX_POOL_INITIALIZER    { { 0 }, 0, 0, 0, IOSUHAX_POOL_DEFAULT_LIMIT, 0 }
+
+void iosuhax_pool_init(iosuhax_pool_t *pool);
+void iosuhax_pool_drain(iosuhax_pool_t *pool);
+void iosuhax_pool_set_limit(iosuhax_pool_t *pool, uint32_t limit);
+
+//! returns a 0x40 aligned buffer of at least size bytes, buffers above the largest size class come from the heap directly
+void *iosuhax_pool_alloc(iosuhax_pool_t *pool, uint32_t size);
+//! size has to be the same that was passed to iosuhax_pool_alloc
+void iosuhax_pool_free(iosuhax_pool_t *pool, void *buffer, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,6 +6,30 @@ extern "C" {
 #endif
 
 #define OS_MUTEX_SIZE                   44
+#define OS_COND_SIZE                    28
+#define OS_MESSAGE_QUEUE_SIZE           0x40
+
+#define OS_THREAD_SIZE                  0x6A0
+
+#define OS_THREAD_ATTRIB_AFFINITY_CPU0  0x01
+#define OS_THREAD_ATTRIB_AFFINITY_CPU1  0x02
+#define OS_THREAD_ATTRIB_AFFINITY_CPU2  0x04
+#define OS_THREAD_ATTRIB_AFFINITY_ANY   0x07
+
+//! OSGetTime ticks per second (bus clock / 4)
+#define OS_TIMER_CLOCK                  (248625000 / 4)
+
+#define OS_MESSAGE_NOBLOCK              0
+#define OS_MESSAGE_BLOCK                1
+
+typedef struct _OSMessage
+{
+    void *message;
+    unsigned int args[3];
+} OSMessage;
+
+typedef void (*IOSAsyncCallback)(int result, void *context);
+typedef int (*OSThreadEntry)(int argc, const char **argv);
 
 #ifndef __WUT__
 //!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -14,6 +38,9 @@ extern "C" {
 extern void (* OSInitMutex)(void* mutex);
 extern void (* OSLockMutex)(void* mutex);
 extern void (* OSUnlockMutex)(void* mutex);
+extern void (* OSInitCond)(void* cond);
+extern void (* OSWaitCond)(void* cond, void* mutex);
+extern void (* OSSignalCond)(void* cond);
 
 //!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //! IOS function
@@ -21,6 +48,32 @@ extern void (* OSUnlockMutex)(void* mutex);
 extern int (*IOS_Ioctl)(int fd, unsigned int request, void *input_buffer,unsigned int input_buffer_len, void *output_buffer, unsigned int output_buffer_len);
 extern int (*IOS_Open)(char *path, unsigned int mode);
 extern int (*IOS_Close)(int fd);
+extern int (*IOS_IoctlAsync)(int fd, unsigned int request, void *input_buffer,unsigned int input_buffer_len, void *output_buffer, unsigned int output_buffer_len, IOSAsyncCallback callback, void *context);
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! Message queue functions
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+extern void (* OSInitMessageQueue)(void *queue, OSMessage *messages, int size);
+extern int (* OSSendMessage)(void *queue, OSMessage *message, int flags);
+extern int (* OSReceiveMessage)(void *queue, OSMessage *message, int flags);
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! Time functions
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+extern long long (* OSGetTime)(void);
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! Atomic functions
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+extern int (* OSCompareAndSwapAtomic64)(volatile unsigned long long *ptr, unsigned long long compare, unsigned long long value);
+extern int (* OSAddAtomic)(volatile unsigned int *ptr, int value);
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! Thread functions
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+extern int (* OSCreateThread)(void *thread, OSThreadEntry entry, int argc, void *argv, void *stack, unsigned int stack_size, int priority, unsigned int attr);
+extern int (* OSResumeThread)(void *thread);
+extern int (* OSJoinThread)(void *thread, int *result);
 #else
 //!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //! Mutex functions
@@ -28,6 +81,9 @@ extern int (*IOS_Close)(int fd);
 extern void OSInitMutex(void* mutex);
 extern void OSLockMutex(void* mutex);
 extern void OSUnlockMutex(void* mutex);
+extern void OSInitCond(void* cond);
+extern void OSWaitCond(void* cond, void* mutex);
+extern void OSSignalCond(void* cond);
 
 //!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //! IOS function
@@ -35,6 +91,32 @@ extern void OSUnlockMutex(void* mutex);
 extern int IOS_Ioctl(int fd, unsigned int request, void *input_buffer,unsigned int input_buffer_len, void *output_buffer, unsigned int output_buffer_len);
 extern int IOS_Open(char *path, unsigned int mode);
 extern int IOS_Close(int fd);
+extern int IOS_IoctlAsync(int fd, unsigned int request, void *input_buffer,unsigned int input_buffer_len, void *output_buffer, unsigned int output_buffer_len, IOSAsyncCallback callback, void *context);
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! Message queue functions
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+extern void OSInitMessageQueue(void *queue, OSMessage *messages, int size);
+extern int OSSendMessage(void *queue, OSMessage *message, int flags);
+extern int OSReceiveMessage(void *queue, OSMessage *message, int flags);
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! Time functions
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+extern long long OSGetTime(void);
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! Atomic functions
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+extern int OSCompareAndSwapAtomic64(volatile unsigned long long *ptr, unsigned long long compare, unsigned long long value);
+extern int OSAddAtomic(volatile unsigned int *ptr, int value);
+
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//! Thread functions
+//!----------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+extern int OSCreateThread(void *thread, OSThreadEntry entry, int argc, void *argv, void *stack, unsigned int stack_size, int priority, unsigned int attr);
+extern int OSResumeThread(void *thread);
+extern int OSJoinThread(void *thread, int *result);
 #endif // __WUT__
 
 #ifdef __cplusplus